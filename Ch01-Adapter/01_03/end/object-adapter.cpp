@@ -1,5 +1,10 @@
 #include <iostream>
 #include <memory>  // For std::unique_ptr and std::make_unique
+#include <variant> // For std::variant and std::visit
+#include <vector>
+#include <concepts>
+#include <chrono>
+#include <string_view>
 
 using namespace std;
 
@@ -57,14 +62,144 @@ private:
     unique_ptr<LegacyComponent> m_adaptee;  // Composition: wraps the LegacyComponent
 };
 
+// Extracts the class from a pointer to a parameterless member function
+template <typename>
+struct MemberFunctionClass;
+
+template <typename Class, typename Result>
+struct MemberFunctionClass<Result (Class::*)()>
+{
+    using type = Class;
+};
+
+template <typename Class, typename Result>
+struct MemberFunctionClass<Result (Class::*)() const>
+{
+    using type = Class;
+};
+
+template <typename Class, typename Result>
+struct MemberFunctionClass<Result (Class::*)() noexcept>
+{
+    using type = Class;
+};
+
+template <typename Class, typename Result>
+struct MemberFunctionClass<Result (Class::*)() const noexcept>
+{
+    using type = Class;
+};
+
+// Generic object adapter: maps any parameterless member function onto run().
+// The adaptee lives inside the adapter, so one allocation covers both.
+template <auto Method>
+class MemberFunctionAdapter : public Component
+{
+public:
+    using Adaptee = typename MemberFunctionClass<decltype(Method)>::type;
+
+    explicit MemberFunctionAdapter(Adaptee adaptee) : m_adaptee(move(adaptee)) {}
+
+    void run() override
+    {
+        (m_adaptee.*Method)();  // Method is a compile-time constant, so this is a direct call
+    }
+
+private:
+    Adaptee m_adaptee;
+};
+
+// Usage: adapt<&LegacyComponent::go>(LegacyComponent())
+template <auto Method>
+unique_ptr<Component> adapt(typename MemberFunctionAdapter<Method>::Adaptee adaptee)
+{
+    return make_unique<MemberFunctionAdapter<Method>>(move(adaptee));
+}
+
+// Times creating and destroying adapters: LegacyAdapter allocates twice, adapt() once
+void benchmarkAdapterCreation(int count)
+{
+    using Clock = chrono::steady_clock;
+
+    const auto legacyStart = Clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        unique_ptr<Component> component = make_unique<LegacyAdapter>();
+    }
+    const chrono::duration<double, milli> legacyTime = Clock::now() - legacyStart;
+
+    const auto adaptStart = Clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        unique_ptr<Component> component = adapt<&LegacyComponent::go>(LegacyComponent());
+    }
+    const chrono::duration<double, milli> adaptTime = Clock::now() - adaptStart;
+
+    cout << count << " adapters - LegacyAdapter: " << legacyTime.count() << " ms, adapt<&LegacyComponent::go>: "
+         << adaptTime.count() << " ms" << endl;
+}
+
+// Any type with a go() method can be adapted
+template <typename T>
+concept GoComponent = requires(T& component) { component.go(); };
+
+// Static object adapter: wraps the adaptee by value, run() is not virtual
+template <GoComponent Adaptee>
+class StaticLegacyAdapter
+{
+public:
+    void run()
+    {
+        cout << "StaticLegacyAdapter::run() -> Calling go()" << endl;
+        m_adaptee.go();  // Adapted call, resolved at compile time
+    }
+
+private:
+    Adaptee m_adaptee;  // Composition without a heap allocation
+};
+
+// Stores components contiguously by value and dispatches run() without vtables
+template <typename... Components>
+class ComponentSet
+{
+public:
+    template <typename T>
+    void add(T component)
+    {
+        m_components.emplace_back(move(component));
+    }
+
+    void runAll()
+    {
+        for (auto& component : m_components)
+        {
+            visit([](auto& c) {
+                using T = decay_t<decltype(c)>;
+                c.T::run();  // Qualified call: no virtual dispatch
+            }, component);
+        }
+    }
+
+private:
+    vector<variant<Components...>> m_components;
+};
+
 // Main function
-int main()
+int main(int argc, char* argv[])
 {
+    // Run with --bench to compare adapter creation costs
+    if (argc > 1 && string_view(argv[1]) == "--bench")
+    {
+        benchmarkAdapterCreation(1'000'000);
+        return 0;
+    }
+
     // Creating components
     const unique_ptr<Component> components[] = {
         make_unique<ConcreteComponentA>(),   // Concrete component A
         make_unique<ConcreteComponentB>(),   // Concrete component B
-        make_unique<LegacyAdapter>()         // Adapter for the legacy component
+        make_unique<LegacyAdapter>(),        // Adapter for the legacy component
+        adapt<&LegacyComponent::go>(LegacyComponent())  // Generic adapter, single allocation
     };
 
     // Loop through each component and call run
@@ -73,5 +208,12 @@ int main()
         component->run();  // Call the appropriate run method for each
     }
 
+    // Same components, stored by value and dispatched statically
+    ComponentSet<ConcreteComponentA, ConcreteComponentB, StaticLegacyAdapter<LegacyComponent>> componentSet;
+    componentSet.add(ConcreteComponentA());
+    componentSet.add(ConcreteComponentB());
+    componentSet.add(StaticLegacyAdapter<LegacyComponent>());
+    componentSet.runAll();
+
     return 0;
 }
@@ -1,5 +1,20 @@
 #include <iostream>
 #include <memory>  // Include this header for std::unique_ptr
+#include <variant>
+#include <vector>
+#include <concepts>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
 
 using namespace std;
 
@@ -50,6 +65,209 @@ public:
     }
 };
 
+// Any type with a go() method can be adapted
+template <typename T>
+concept GoComponent = requires(T& component) { component.go(); };
+
+// Static class adapter: inherits the adaptee privately, run() is not virtual
+template <GoComponent Adaptee>
+class StaticClassAdapter : private Adaptee
+{
+public:
+    void run()
+    {
+        cout << "StaticClassAdapter::run() -> Calling go()" << endl;
+        Adaptee::go();
+    }
+};
+
+// Stores components contiguously by value and dispatches run() without vtables
+template <typename... Components>
+class ComponentSet
+{
+public:
+    template <typename T>
+    void add(T component)
+    {
+        m_components.emplace_back(move(component));
+    }
+
+    void runAll()
+    {
+        for (auto& component : m_components)
+        {
+            visit([](auto& c) {
+                using T = decay_t<decltype(c)>;
+                c.T::run();  // Qualified call: no virtual dispatch
+            }, component);
+        }
+    }
+
+private:
+    vector<variant<Components...>> m_components;
+};
+
+// Runs batches of Components on a work-stealing thread pool. Each worker owns a
+// deque; it pops its own work from the back and steals from the front of the
+// others. Components that share a non-negative ordering group run one after
+// another in submission order; all other components are independent.
+class ComponentExecutor
+{
+public:
+    explicit ComponentExecutor(size_t threadCount = max(1u, thread::hardware_concurrency()))
+    {
+        // Slot 0 belongs to the thread calling execute(), which helps out.
+        for (size_t i = 0; i <= threadCount; ++i)
+            m_queues.push_back(make_unique<WorkQueue>());
+        for (size_t i = 1; i <= threadCount; ++i)
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ComponentExecutor(const ComponentExecutor&) = delete;
+    ComponentExecutor& operator=(const ComponentExecutor&) = delete;
+
+    ~ComponentExecutor()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    // Runs every component once and returns how long each run() took, by index.
+    // orderGroups is either empty or holds one group per component (-1 for none).
+    vector<chrono::nanoseconds> execute(const vector<Component*>& components, const vector<int>& orderGroups = {})
+    {
+        if (!orderGroups.empty() && orderGroups.size() != components.size())
+            throw invalid_argument("ComponentExecutor: one ordering group per component expected");
+
+        lock_guard<mutex> batchLock(m_batchMutex);
+        vector<chrono::nanoseconds> timings(components.size());
+        vector<function<void()>> tasks;
+        map<int, vector<size_t>> groups;
+        for (size_t i = 0; i < components.size(); ++i)
+        {
+            const int group = orderGroups.empty() ? -1 : orderGroups[i];
+            if (group < 0)
+                tasks.push_back([&, i] { runTimed(components, timings, i); });
+            else
+                groups[group].push_back(i);
+        }
+        for (auto& [group, members] : groups)
+            tasks.push_back([&, members = move(members)] {
+                for (size_t i : members)
+                    runTimed(components, timings, i);
+            });
+
+        m_pending = tasks.size();
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            WorkQueue& queue = *m_queues[i % m_queues.size()];
+            lock_guard<mutex> lock(queue.queueMutex);
+            queue.tasks.push_back(move(tasks[i]));
+            ++m_queued;
+        }
+        {
+            lock_guard<mutex> lock(m_mutex);
+        }
+        m_wake.notify_all();
+
+        while (tryRunTask(0))
+        {
+        }
+        unique_lock<mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending == 0; });
+
+        if (m_error)
+            rethrow_exception(exchange(m_error, nullptr));
+        return timings;
+    }
+
+private:
+    struct WorkQueue
+    {
+        mutex queueMutex;
+        deque<function<void()>> tasks;
+    };
+
+    void runTimed(const vector<Component*>& components, vector<chrono::nanoseconds>& timings, size_t index)
+    {
+        const auto start = chrono::steady_clock::now();
+        try
+        {
+            components[index]->run();
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_error)
+                m_error = current_exception();
+        }
+        timings[index] = chrono::steady_clock::now() - start;
+    }
+
+    // Runs one task from our own queue or, failing that, one stolen from another.
+    bool tryRunTask(size_t self)
+    {
+        for (size_t k = 0; k < m_queues.size(); ++k)
+        {
+            WorkQueue& queue = *m_queues[(self + k) % m_queues.size()];
+            function<void()> task;
+            {
+                lock_guard<mutex> lock(queue.queueMutex);
+                if (queue.tasks.empty())
+                    continue;
+                if (k == 0)
+                {
+                    task = move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                --m_queued;
+            }
+            task();
+            if (--m_pending == 0)
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self)
+    {
+        for (;;)
+        {
+            if (tryRunTask(self))
+                continue;
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0)
+                return;
+        }
+    }
+
+    vector<unique_ptr<WorkQueue>> m_queues;
+    vector<thread> m_workers;
+    mutex m_batchMutex;
+    mutex m_mutex;
+    condition_variable m_wake;
+    condition_variable m_done;
+    atomic<size_t> m_queued{0};
+    atomic<size_t> m_pending{0};
+    exception_ptr m_error;
+    bool m_stopping = false;
+};
+
 int main()
 {
     // Correct the usage of std::unique_ptr
@@ -64,5 +282,21 @@ int main()
     {
         component->run();
     }
+
+    ComponentSet<ConcreteComponentA, ConcreteComponentB, StaticClassAdapter<LegacyComponent>> componentSet;
+    componentSet.add(ConcreteComponentA());
+    componentSet.add(ConcreteComponentB());
+    componentSet.add(StaticClassAdapter<LegacyComponent>());
+    componentSet.runAll();
+
+    // Run the same components on the executor; the adapter is just another Component
+    ComponentExecutor executor;
+    vector<Component*> batch;
+    for (const auto& component : components)
+        batch.push_back(component.get());
+    const auto timings = executor.execute(batch, { 0, 0, -1 });  // A before B, legacy independent
+    for (size_t i = 0; i < timings.size(); ++i)
+        cout << "Component " << i << " took " << timings[i].count() << " ns" << endl;
+
     return 0;
 }
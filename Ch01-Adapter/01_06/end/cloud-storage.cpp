@@ -1,16 +1,340 @@
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <span>
+#include <cstddef>
 #include <memory>
-#include <ctime>
 #include <random>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <deque>
+#include <array>
+#include <bit>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstring>
+#include <optional>
 
 using namespace std;
 
+// Severity of a log record; Off disables logging entirely.
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+// Destination for formatted log lines. Only the logger's writer thread calls
+// write() and flush(), so sinks need no locking of their own.
+class LogSink
+{
+public:
+    virtual void write(LogLevel level, string_view line) = 0;
+    virtual void flush() {}
+    virtual ~LogSink() = default;
+};
+
+// Default sink: one line per record, flushed once per batch rather than per line.
+class ConsoleSink : public LogSink
+{
+public:
+    virtual void write(LogLevel, string_view line) override { cout << line << '\n'; }
+    virtual void flush() override { cout.flush(); }
+};
+
+// Asynchronous logger. Each thread appends fixed-size records to its own
+// lock-free single-producer ring; a background writer merges them in global
+// sequence order and hands them to the sink. Records below the runtime level
+// cost one relaxed atomic load and are never formatted.
+class Logger
+{
+public:
+    static Logger& instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    void setLevel(LogLevel level) { m_level.store(level, memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= m_level.load(memory_order_relaxed); }
+
+    void setSink(unique_ptr<LogSink> sink)
+    {
+        flush();
+        lock_guard<mutex> lock(m_sinkMutex);
+        m_sink = move(sink);
+    }
+
+    template <typename... Args>
+    void log(LogLevel level, const Args&... args)
+    {
+        if (!enabled(level))
+            return;
+
+        // Format straight into the record; bytes past its end are never copied,
+        // so logging a large payload costs no more than logging its prefix.
+        Record record;
+        TruncatingBuffer buffer(record.text, sizeof(record.text));
+        thread_local ostream stream(nullptr);
+        stream.rdbuf(&buffer);
+        stream.flags(ios_base::skipws | ios_base::dec);
+        ((stream << args), ...);
+        stream.rdbuf(nullptr);
+
+        record.level = level;
+        record.length = static_cast<uint16_t>(buffer.length());
+        record.sequence = m_nextSequence.fetch_add(1, memory_order_relaxed);
+        threadRing().push(record);
+        wakeWriter();
+    }
+
+    // Blocks until every record logged before this call has reached the sink.
+    void flush()
+    {
+        const uint64_t target = m_nextSequence.load(memory_order_relaxed);
+        while (m_written.load(memory_order_acquire) < target)
+            this_thread::yield();
+    }
+
+    ~Logger()
+    {
+        flush();
+        m_stopping = true;
+        wakeWriter();
+        m_writer.join();
+    }
+
+private:
+    struct Record
+    {
+        uint64_t sequence;
+        LogLevel level;
+        uint16_t length;
+        char text[256]; // Longer lines are truncated.
+    };
+
+    // Stream buffer over a fixed array that silently drops what does not fit.
+    class TruncatingBuffer : public streambuf
+    {
+    public:
+        TruncatingBuffer(char* data, size_t size) { setp(data, data + size); }
+        size_t length() const { return static_cast<size_t>(pptr() - pbase()); }
+
+    protected:
+        virtual int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+
+        virtual streamsize xsputn(const char* text, streamsize count) override
+        {
+            const streamsize kept = min(count, static_cast<streamsize>(epptr() - pptr()));
+            memcpy(pptr(), text, static_cast<size_t>(kept));
+            pbump(static_cast<int>(kept));
+            return count;
+        }
+    };
+
+    // Single-producer, single-consumer ring; push() waits while the ring is full.
+    class Ring
+    {
+    public:
+        void push(const Record& record)
+        {
+            const size_t tail = m_tail.load(memory_order_relaxed);
+            while (tail - m_head.load(memory_order_acquire) == capacity)
+                this_thread::yield();
+            m_records[tail % capacity] = record;
+            m_tail.store(tail + 1, memory_order_release);
+        }
+
+        bool pop(Record& record)
+        {
+            const size_t head = m_head.load(memory_order_relaxed);
+            if (head == m_tail.load(memory_order_acquire))
+                return false;
+            record = m_records[head % capacity];
+            m_head.store(head + 1, memory_order_release);
+            return true;
+        }
+
+        bool empty() const { return m_head.load(memory_order_acquire) == m_tail.load(memory_order_acquire); }
+
+    private:
+        static constexpr size_t capacity = 1024;
+        array<Record, capacity> m_records;
+        alignas(64) atomic<size_t> m_head{0};
+        alignas(64) atomic<size_t> m_tail{0};
+    };
+
+    struct LaterSequence
+    {
+        bool operator()(const Record& a, const Record& b) const { return a.sequence > b.sequence; }
+    };
+
+    Logger() : m_sink(make_unique<ConsoleSink>()), m_writer([this] { writerLoop(); }) {}
+
+    Ring& threadRing()
+    {
+        thread_local shared_ptr<Ring> ring = [this] {
+            auto created = make_shared<Ring>();
+            lock_guard<mutex> lock(m_ringsMutex);
+            m_rings.push_back(created);
+            return created;
+        }();
+        return *ring;
+    }
+
+    // Bumped after every push; the idle writer sleeps until it changes.
+    void wakeWriter()
+    {
+        m_wakeups.fetch_add(1, memory_order_release);
+        m_wakeups.notify_one();
+    }
+
+    void writerLoop()
+    {
+        priority_queue<Record, vector<Record>, LaterSequence> pending;
+        uint64_t next = 0;
+        for (;;)
+        {
+            // Read before draining, so a push that lands after the drain
+            // changes the value and the wait below returns at once.
+            const uint32_t wakeups = m_wakeups.load(memory_order_acquire);
+            {
+                lock_guard<mutex> lock(m_ringsMutex);
+                Record record;
+                for (auto& ring : m_rings)
+                    while (ring->pop(record))
+                        pending.push(record);
+                // Rings whose thread has exited are dropped once drained.
+                erase_if(m_rings, [](const shared_ptr<Ring>& ring) { return ring.use_count() == 1 && ring->empty(); });
+            }
+
+            bool wrote = false;
+            {
+                lock_guard<mutex> lock(m_sinkMutex);
+                // A gap means that record is still being pushed by its thread; wait for it.
+                while (!pending.empty() && pending.top().sequence == next)
+                {
+                    const Record& record = pending.top();
+                    m_sink->write(record.level, string_view(record.text, record.length));
+                    pending.pop();
+                    ++next;
+                    wrote = true;
+                }
+                if (wrote)
+                    m_sink->flush();
+            }
+            m_written.store(next, memory_order_release);
+
+            if (!wrote)
+            {
+                if (m_stopping && pending.empty())
+                    return;
+                m_wakeups.wait(wakeups, memory_order_acquire);
+            }
+        }
+    }
+
+    atomic<LogLevel> m_level{LogLevel::Info};
+    atomic<uint64_t> m_nextSequence{0};
+    atomic<uint64_t> m_written{0};
+    atomic<bool> m_stopping{false};
+    atomic<uint32_t> m_wakeups{0};
+    mutex m_ringsMutex;
+    vector<shared_ptr<Ring>> m_rings;
+    mutex m_sinkMutex;
+    unique_ptr<LogSink> m_sink;
+    thread m_writer;
+};
+
+template <typename... Args>
+void logMessage(LogLevel level, const Args&... args)
+{
+    Logger::instance().log(level, args...);
+}
+
+// Non-owning views over payload bytes, so callers holding mmap'd files or
+// network buffers can upload without first building a std::string.
+using ByteSpan = span<const byte>;
+using ByteSegments = span<const ByteSpan>;
+
+inline ByteSpan asBytes(string_view text)
+{
+    return as_bytes(span(text.data(), text.size()));
+}
+
+inline string_view asText(ByteSpan bytes)
+{
+    return string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// FNV-1a checksum carried with every multipart part.
+inline uint32_t partChecksum(ByteSpan bytes)
+{
+    uint32_t hash = 2166136261u;
+    for (const byte b : bytes)
+        hash = (hash ^ to_integer<uint32_t>(b)) * 16777619u;
+    return hash;
+}
+
 // Abstract class representing cloud storage.
 class CloudStorage
 {
 public:
+    // Leads every part object stored by the default uploadPart().
+    struct PartHeader
+    {
+        uint64_t uploadId;
+        uint64_t partNumber;
+    };
+
+    // Leads the manifest stored by the default completeMultipart(); one
+    // checksum per part follows, in part order.
+    struct MultipartManifest
+    {
+        uint64_t uploadId;
+        uint64_t partCount;
+    };
+
+    // Uploads one part of a multipart upload. Backends without native multipart
+    // support verify the checksum and store the part as a standalone object
+    // tagged with its upload ID and part number.
+    virtual bool uploadPart(uint64_t uploadId, size_t partNumber, ByteSpan part, uint32_t checksum)
+    {
+        if (partChecksum(part) != checksum)
+            return false;
+        const PartHeader header{uploadId, partNumber};
+        const ByteSpan object[] = {as_bytes(span(&header, 1)), part};
+        return uploadContents(ByteSegments(object));
+    }
+
+    // Tells the backend that every part has landed. By default this stores a
+    // manifest naming the upload and each part's checksum, which is what it
+    // takes to put the part objects back together.
+    virtual bool completeMultipart(uint64_t uploadId, size_t partCount, span<const uint32_t> checksums)
+    {
+        if (checksums.size() != partCount)
+            return false;
+        const MultipartManifest manifest{uploadId, partCount};
+        const ByteSpan object[] = {as_bytes(span(&manifest, 1)), as_bytes(checksums)};
+        logMessage(LogLevel::Debug, "CloudStorage::completeMultipart() -> manifest for ", partCount, " parts");
+        return uploadContents(ByteSegments(object));
+    }
+
+    // Drops an upload that will never be completed. Parts already stored stay
+    // behind as orphans; backends that track sessions release them here.
+    virtual void abortMultipart(uint64_t uploadId) { (void)uploadId; }
+
     virtual bool uploadContents(const string &content) = 0;
+    virtual bool uploadContents(ByteSpan content) = 0;
+    // Scatter-gather upload: the segments form one object, in order.
+    virtual bool uploadContents(ByteSegments segments) = 0;
     virtual int getFreeSpace() = 0;
     virtual ~CloudStorage() = default;
 };
@@ -21,8 +345,21 @@ class CloudDrive : public CloudStorage
 public:
     virtual bool uploadContents(const string& content) override
     {
-        cout << "Uploading " << content.length() << " bytes to CloudDrive: " << endl;
-        return true;
+        return uploadContents(asBytes(content));
+    }
+
+    virtual bool uploadContents(ByteSpan content) override
+    {
+        return storeObject(content.size());
+    }
+
+    virtual bool uploadContents(ByteSegments segments) override
+    {
+        size_t size = 0;
+        for (const auto& segment : segments)
+            size += segment.size();
+        logMessage(LogLevel::Debug, "CloudDrive::uploadContents(segments) -> ", segments.size(), " segments as one object");
+        return storeObject(size);
     }
 
     virtual int getFreeSpace() override
@@ -33,9 +370,16 @@ public:
         uniform_int_distribution<> dis(0, 20); // Random space between 0 and 20GB.
 
         int size = dis(gen);
-        cout << "Available CloudDrive storage: " << size << "GB" << endl;
+        logMessage(LogLevel::Info, "Available CloudDrive storage: ", size, "GB");
         return size;
     }
+
+private:
+    bool storeObject(size_t size)
+    {
+        logMessage(LogLevel::Info, "Uploading ", size, " bytes to CloudDrive: ");
+        return true;
+    }
 };
 
 // FastShare class implementation.
@@ -44,8 +388,21 @@ class FastShare : public CloudStorage
 public:
     virtual bool uploadContents(const string& content) override
     {
-        cout << "Uploading " << content.length() << " bytes to FastShare: " << endl;
-        return true;
+        return uploadContents(asBytes(content));
+    }
+
+    virtual bool uploadContents(ByteSpan content) override
+    {
+        return storeObject(content.size());
+    }
+
+    virtual bool uploadContents(ByteSegments segments) override
+    {
+        size_t size = 0;
+        for (const auto& segment : segments)
+            size += segment.size();
+        logMessage(LogLevel::Debug, "FastShare::uploadContents(segments) -> ", segments.size(), " segments as one object");
+        return storeObject(size);
     }
 
     virtual int getFreeSpace() override
@@ -56,18 +413,34 @@ public:
         uniform_int_distribution<> dis(0, 10); // Random space between 0 and 10GB.
 
         int size = dis(gen);
-        cout << "Available FastShare storage: " << size << "GB" << endl;
+        logMessage(LogLevel::Info, "Available FastShare storage: ", size, "GB");
         return size;
     }    
+
+private:
+    bool storeObject(size_t size)
+    {
+        logMessage(LogLevel::Info, "Uploading ", size, " bytes to FastShare: ");
+        return true;
+    }
 };
 
 // 3rd party service VirtualDrive.
 class VirtualDrive
 {
 public:
-    bool uploadData(const string& data, const int uniqueID)
+    bool uploadData(string_view data, const uint64_t uniqueID)
     {
-        cout << "Uploading to VirtualDrive: \"" << data << "\" ID: " << uniqueID << endl;
+        logMessage(LogLevel::Info, "Uploading to VirtualDrive: \"", data, "\" ID: ", uniqueID);
+        return true;
+    }
+
+    // Vectored upload of several buffers as one object.
+    bool uploadData(span<const string_view> parts, const uint64_t uniqueID)
+    {
+        logMessage(LogLevel::Info, "Uploading ", parts.size(), " parts to VirtualDrive, ID: ", uniqueID);
+        for (const auto& part : parts)
+            logMessage(LogLevel::Info, "  part: \"", part, "\"");
         return true;
     }
 
@@ -84,36 +457,1059 @@ public:
     static const int totalSpace = 15; // Total space is 15GB.
 };
 
+// Snowflake-style 64-bit ID generator: 41 bits of milliseconds since a custom
+// epoch, 8 bits of thread shard and a 14 bit per-millisecond sequence. Each
+// thread leases its own shard and sequence, so next() needs no locks or
+// atomics. Leases go back to a free list when their thread exits; if more
+// threads are alive than there are shards, the extra ones share the last
+// shard under a lock.
+class UniqueIdGenerator
+{
+public:
+    static constexpr int sequenceBits = 14;
+    static constexpr int shardBits = 8;
+    static constexpr uint64_t maxSequence = (uint64_t{1} << sequenceBits) - 1;
+    static constexpr uint64_t maxShards = uint64_t{1} << shardBits;
+
+    static uint64_t next()
+    {
+        thread_local ShardLease lease;
+        if (lease.state)
+            return advance(*lease.state);
+
+        ShardPool& shards = pool();
+        lock_guard<mutex> lock(shards.overflowMutex);
+        return advance(shards.overflow);
+    }
+
+private:
+    struct State
+    {
+        uint64_t shard;
+        uint64_t lastTimestamp = 0;
+        uint64_t sequence = 0;
+    };
+
+    struct ShardPool
+    {
+        mutex leaseMutex;
+        vector<State> released; // Keeps each shard's last timestamp, so a new owner never repeats an ID.
+        uint64_t nextShard = 0;
+        mutex overflowMutex;
+        State overflow{maxShards - 1};
+    };
+
+    // Owns a shard for the lifetime of the calling thread.
+    struct ShardLease
+    {
+        ShardLease()
+        {
+            ShardPool& shards = pool();
+            lock_guard<mutex> lock(shards.leaseMutex);
+            if (!shards.released.empty())
+            {
+                state = shards.released.back();
+                shards.released.pop_back();
+            }
+            else if (shards.nextShard < maxShards - 1)
+            {
+                state = State{shards.nextShard++};
+            }
+        }
+
+        ~ShardLease()
+        {
+            if (!state)
+                return;
+            ShardPool& shards = pool();
+            lock_guard<mutex> lock(shards.leaseMutex);
+            shards.released.push_back(*state);
+        }
+
+        optional<State> state;
+    };
+
+    static ShardPool& pool()
+    {
+        static ShardPool shards;
+        return shards;
+    }
+
+    static uint64_t advance(State& state)
+    {
+        uint64_t timestamp = max(currentMillis(), state.lastTimestamp);
+        if (timestamp == state.lastTimestamp)
+        {
+            state.sequence = (state.sequence + 1) & maxSequence;
+            if (state.sequence == 0)
+            {
+                // Sequence exhausted for this millisecond; wait for the clock to move on.
+                while (timestamp <= state.lastTimestamp)
+                    timestamp = currentMillis();
+            }
+        }
+        else
+        {
+            state.sequence = 0;
+        }
+        state.lastTimestamp = timestamp;
+
+        return (timestamp << (shardBits + sequenceBits)) | (state.shard << sequenceBits) | state.sequence;
+    }
+
+    static uint64_t currentMillis()
+    {
+        // 2024-01-01T00:00:00Z, keeps the 41-bit timestamp good for ~69 years.
+        constexpr uint64_t customEpochMillis = 1704067200000;
+        const auto now = chrono::system_clock::now().time_since_epoch();
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(now).count()) - customEpochMillis;
+    }
+};
+
+// Measures UniqueIdGenerator throughput across all cores and checks for
+// duplicates. `totalIds` is split between the threads, so memory use does
+// not grow with the core count.
+void benchmarkUniqueIds(size_t totalIds)
+{
+    const unsigned threadCount = max(1u, thread::hardware_concurrency());
+    const size_t idsPerThread = max<size_t>(1, totalIds / threadCount);
+    vector<uint64_t> all(threadCount * idsPerThread);
+    const auto slice = [&](unsigned t) { return span(all).subspan(t * idsPerThread, idsPerThread); };
+
+    const auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t)
+        threads.emplace_back([&slice, t] {
+            for (auto& id : slice(t))
+                id = UniqueIdGenerator::next();
+        });
+    for (auto& worker : threads)
+        worker.join();
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    bool monotonic = true;
+    for (unsigned t = 0; t < threadCount; ++t)
+        monotonic = monotonic && is_sorted(slice(t).begin(), slice(t).end());
+    sort(all.begin(), all.end());
+    const bool unique = adjacent_find(all.begin(), all.end()) == all.end();
+
+    cout << "Generated " << all.size() << " IDs on " << threadCount << " threads in " << elapsed.count() << "s ("
+         << all.size() / elapsed.count() / 1e6 << "M IDs/s), unique: " << boolalpha << unique
+         << ", per-thread monotonic: " << monotonic << endl;
+}
+
 // Adapter for VirtualDrive to fit CloudStorage interface.
 class VirtualDriveAdapter : public CloudStorage, private VirtualDrive
 {
 public:
     virtual bool uploadContents(const string& content) override
     {
-        int uniqueID = generateUID(); // Generate a unique ID for this content.
-        cout << "VirtualDriveAdapter::uploadContents() -> Calling VirtualDrive::uploadData()" << endl;
-        return uploadData(content, uniqueID);
+        uint64_t uniqueID = generateUID(); // Generate a unique ID for this content.
+        logMessage(LogLevel::Debug, "VirtualDriveAdapter::uploadContents() -> Calling VirtualDrive::uploadData()");
+        return uploadData(string_view(content), uniqueID);
+    }
+
+    virtual bool uploadContents(ByteSpan content) override
+    {
+        uint64_t uniqueID = generateUID();
+        logMessage(LogLevel::Debug, "VirtualDriveAdapter::uploadContents(span) -> Calling VirtualDrive::uploadData()");
+        return uploadData(asText(content), uniqueID); // Views the caller's bytes, no copy.
+    }
+
+    virtual bool uploadContents(ByteSegments segments) override
+    {
+        // Only the small array of views is built here; the payload bytes stay in place.
+        vector<string_view> parts;
+        parts.reserve(segments.size());
+        for (const auto& segment : segments)
+            parts.push_back(asText(segment));
+
+        uint64_t uniqueID = generateUID();
+        logMessage(LogLevel::Debug, "VirtualDriveAdapter::uploadContents(segments) -> Calling VirtualDrive::uploadData()");
+        return uploadData(span<const string_view>(parts), uniqueID);
     }
 
     virtual int getFreeSpace() override
     {
         int available = totalSpace - usedSpace(); // Calculate available space.
-        cout << "VirtualDriveAdapter::getFreeSpace() -> Available VirtualDrive storage: " << available << " GB" << endl;
+        logMessage(LogLevel::Info, "VirtualDriveAdapter::getFreeSpace() -> Available VirtualDrive storage: ",
+                   available, " GB");
         return available;
     }
 
+    // Each part becomes its own VirtualDrive object, keyed by an ID derived from the session.
+    virtual bool uploadPart(uint64_t uploadId, size_t partNumber, ByteSpan part, uint32_t checksum) override
+    {
+        if (partChecksum(part) != checksum)
+            return false;
+        const uint64_t partID = derivePartID(uploadId, partNumber);
+        logMessage(LogLevel::Debug, "VirtualDriveAdapter::uploadPart() -> Calling VirtualDrive::uploadData() for part ",
+                   partNumber);
+        return uploadData(asText(part), partID);
+    }
+
+    // VirtualDrive stores text, so the manifest is written out as text under
+    // the upload ID itself; the parts are found again through derivePartID().
+    virtual bool completeMultipart(uint64_t uploadId, size_t partCount, span<const uint32_t> checksums) override
+    {
+        if (checksums.size() != partCount)
+            return false;
+        string manifest = "multipart " + to_string(uploadId) + ", " + to_string(partCount) + " parts, checksums:";
+        for (const uint32_t checksum : checksums)
+            manifest += " " + to_string(checksum);
+        logMessage(LogLevel::Debug, "VirtualDriveAdapter::completeMultipart() -> Calling VirtualDrive::uploadData()");
+        return uploadData(string_view(manifest), uploadId & ~(uint64_t{1} << 63));
+    }
+
+private:
+    // Mixes the session ID and part number (splitmix64 finalizer) into a part ID.
+    static uint64_t derivePartID(uint64_t uploadId, size_t partNumber)
+    {
+        uint64_t x = uploadId ^ (static_cast<uint64_t>(partNumber) * 0x9e3779b97f4a7c15ull);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return (x ^ (x >> 31)) & ~(uint64_t{1} << 63);
+    }
+
+    // Generates a unique, per-thread monotonic ID for this upload.
+    uint64_t generateUID()
+    {
+        return UniqueIdGenerator::next();
+    }
+};
+
+// Decorator that caches getFreeSpace() for a time-to-live. Concurrent callers
+// that miss the cache wait for the single query already in flight instead of
+// issuing their own.
+class CachedFreeSpaceStorage : public CloudStorage
+{
+public:
+    CachedFreeSpaceStorage(unique_ptr<CloudStorage> storage, chrono::steady_clock::duration ttl)
+        : m_storage(move(storage)), m_ttl(ttl) {}
+
+    virtual bool uploadContents(const string& content) override { return m_storage->uploadContents(content); }
+    virtual bool uploadContents(ByteSpan content) override { return m_storage->uploadContents(content); }
+    virtual bool uploadContents(ByteSegments segments) override { return m_storage->uploadContents(segments); }
+    virtual bool uploadPart(uint64_t uploadId, size_t partNumber, ByteSpan part, uint32_t checksum) override
+    {
+        return m_storage->uploadPart(uploadId, partNumber, part, checksum);
+    }
+    virtual bool completeMultipart(uint64_t uploadId, size_t partCount, span<const uint32_t> checksums) override
+    {
+        return m_storage->completeMultipart(uploadId, partCount, checksums);
+    }
+    virtual void abortMultipart(uint64_t uploadId) override { m_storage->abortMultipart(uploadId); }
+
+    virtual int getFreeSpace() override
+    {
+        unique_lock<mutex> lock(m_mutex);
+        // Re-check after every wake-up: the query we waited for may have failed,
+        // or its value may already be older than the TTL.
+        for (;;)
+        {
+            if (m_hasValue && chrono::steady_clock::now() - m_fetchedAt < m_ttl)
+            {
+                ++m_hits;
+                return m_freeSpace;
+            }
+            if (!m_queryInFlight)
+                break;
+            m_queryDone.wait(lock, [this] { return !m_queryInFlight; });
+        }
+
+        ++m_misses;
+        m_queryInFlight = true;
+        lock.unlock();
+        int freeSpace = 0;
+        try
+        {
+            freeSpace = m_storage->getFreeSpace();
+        }
+        catch (...)
+        {
+            lock.lock();
+            m_queryInFlight = false;
+            m_queryDone.notify_all();
+            throw;
+        }
+        lock.lock();
+        m_freeSpace = freeSpace;
+        m_fetchedAt = chrono::steady_clock::now();
+        m_hasValue = true;
+        m_queryInFlight = false;
+        m_queryDone.notify_all();
+        return freeSpace;
+    }
+
+    // Drops the cached value so the next call queries the backend, e.g. after an upload.
+    void invalidate()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_hasValue = false;
+    }
+
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+private:
+    unique_ptr<CloudStorage> m_storage;
+    const chrono::steady_clock::duration m_ttl;
+    mutex m_mutex;
+    condition_variable m_queryDone;
+    bool m_queryInFlight = false;
+    bool m_hasValue = false;
+    int m_freeSpace = 0;
+    chrono::steady_clock::time_point m_fetchedAt;
+    atomic<size_t> m_hits{0};
+    atomic<size_t> m_misses{0};
+};
+
+// Bounded worker pool that uploads batches of payloads to any CloudStorage.
+// submit() blocks while the queue is full, which gives callers backpressure.
+class UploadPool
+{
+public:
+    UploadPool(size_t workerCount, size_t queueCapacity) : m_capacity(queueCapacity)
+    {
+        if (workerCount == 0 || queueCapacity == 0)
+            throw invalid_argument("UploadPool: needs at least one worker and one queue slot");
+        for (size_t i = 0; i < workerCount; ++i)
+            m_workers.emplace_back([this] { workerLoop(); });
+    }
+
+    UploadPool(const UploadPool&) = delete;
+    UploadPool& operator=(const UploadPool&) = delete;
+
+    ~UploadPool()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_notEmpty.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    // Queues a single upload and returns a future for its result.
+    future<bool> submit(CloudStorage& storage, string content)
+    {
+        return submit(packaged_task<bool()>([&storage, content = move(content)] {
+            return storage.uploadContents(content);
+        }));
+    }
+
+    // Queues any upload step, e.g. one part of a multipart upload.
+    future<bool> submit(packaged_task<bool()> task)
+    {
+        future<bool> result = task.get_future();
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_tasks.size() < m_capacity; });
+            m_tasks.push(move(task));
+        }
+        m_notEmpty.notify_one();
+        return result;
+    }
+
+    // Queues every payload of a batch; futures are returned in submission order.
+    vector<future<bool>> submitBatch(CloudStorage& storage, const vector<string>& contents)
+    {
+        vector<future<bool>> results;
+        results.reserve(contents.size());
+        for (const auto& content : contents)
+            results.push_back(submit(storage, content));
+        return results;
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;)
+        {
+            packaged_task<bool()> task;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_notEmpty.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                    return;
+                task = move(m_tasks.front());
+                m_tasks.pop();
+            }
+            m_notFull.notify_one();
+            task();
+        }
+    }
+
+    const size_t m_capacity;
+    vector<thread> m_workers;
+    queue<packaged_task<bool()>> m_tasks;
+    mutex m_mutex;
+    condition_variable m_notEmpty;
+    condition_variable m_notFull;
+    bool m_stopping = false;
+};
+
+// Streaming upload session: write() buffers bytes into fixed-size parts and
+// sends full parts in parallel, so memory use is bounded by partSize times
+// concurrency instead of by the object size. Parts run on an UploadPool, either
+// one shared with other work or one of `concurrency` workers owned by the
+// session. A failed part is retried on its own; commit() flushes the last part
+// and, once every part has landed, asks the backend to complete the upload.
+class MultipartUpload
+{
+public:
+    struct Options
+    {
+        size_t partSize = 8 * 1024 * 1024;
+        size_t concurrency = 4;
+        int maxAttempts = 3;
+    };
+
+    MultipartUpload(CloudStorage& storage, Options options) : MultipartUpload(storage, options, nullptr) {}
+
+    // Parts are sent on `pool`; it must outlive the session.
+    MultipartUpload(CloudStorage& storage, Options options, UploadPool& pool)
+        : MultipartUpload(storage, options, &pool) {}
+
+    MultipartUpload(const MultipartUpload&) = delete;
+    MultipartUpload& operator=(const MultipartUpload&) = delete;
+
+    ~MultipartUpload()
+    {
+        // Never leave parts running against a storage we only hold by reference.
+        for (auto& part : m_inFlight)
+            part.wait();
+        if (!m_committed)
+            m_storage.abortMultipart(m_uploadId);
+    }
+
+    void write(ByteSpan data)
+    {
+        if (m_committed)
+            throw logic_error("MultipartUpload: write after commit");
+        while (!data.empty())
+        {
+            const size_t take = min(data.size(), m_options.partSize - m_buffer.size());
+            m_buffer.insert(m_buffer.end(), data.begin(), data.begin() + take);
+            data = data.subspan(take);
+            if (m_buffer.size() == m_options.partSize)
+                sendBufferedPart();
+        }
+    }
+
+    bool commit()
+    {
+        if (m_committed)
+            throw logic_error("MultipartUpload: commit called twice");
+        m_committed = true;
+        if (!m_buffer.empty() || m_partCount == 0)
+            sendBufferedPart();
+        while (!m_inFlight.empty())
+            collectOldestPart();
+        if (!m_allSucceeded)
+        {
+            m_storage.abortMultipart(m_uploadId);
+            return false;
+        }
+        const vector<uint32_t> checksums(m_checksums.begin(), m_checksums.end());
+        return m_storage.completeMultipart(m_uploadId, m_partCount, checksums);
+    }
+
+    uint64_t uploadId() const { return m_uploadId; }
+    size_t partCount() const { return m_partCount; }
+
+private:
+    MultipartUpload(CloudStorage& storage, Options options, UploadPool* pool)
+        : m_storage(storage), m_options(options), m_uploadId(UniqueIdGenerator::next()),
+          m_ownPool(pool ? nullptr : make_unique<UploadPool>(max<size_t>(options.concurrency, 1), max<size_t>(options.concurrency, 1))),
+          m_pool(pool ? *pool : *m_ownPool)
+    {
+        if (m_options.partSize == 0 || m_options.concurrency == 0 || m_options.maxAttempts < 1)
+            throw invalid_argument("MultipartUpload: invalid options");
+        m_buffer.reserve(m_options.partSize);
+    }
+
+    void sendBufferedPart()
+    {
+        if (m_inFlight.size() == m_options.concurrency)
+            collectOldestPart();
+
+        vector<byte> part;
+        part.swap(m_buffer);
+        m_buffer.reserve(m_options.partSize);
+        const size_t partNumber = m_partCount++;
+        // Deque elements stay put as it grows, so the task can fill in its slot.
+        uint32_t& checksum = m_checksums.emplace_back();
+        m_inFlight.push_back(m_pool.submit(packaged_task<bool()>([this, partNumber, &checksum, part = move(part)] {
+            checksum = partChecksum(part);
+            for (int attempt = 0; attempt < m_options.maxAttempts; ++attempt)
+            {
+                try
+                {
+                    if (m_storage.uploadPart(m_uploadId, partNumber, part, checksum))
+                        return true;
+                }
+                catch (const exception&)
+                {
+                    // Treated like a failed attempt; the part is retried.
+                }
+            }
+            return false;
+        })));
+    }
+
+    void collectOldestPart()
+    {
+        m_allSucceeded = m_inFlight.front().get() && m_allSucceeded;
+        m_inFlight.pop_front();
+    }
+
+    CloudStorage& m_storage;
+    const Options m_options;
+    const uint64_t m_uploadId;
+    unique_ptr<UploadPool> m_ownPool;
+    UploadPool& m_pool;
+    vector<byte> m_buffer;
+    deque<future<bool>> m_inFlight;
+    deque<uint32_t> m_checksums; // One per part, filled in by the part's task.
+    size_t m_partCount = 0;
+    bool m_allSucceeded = true;
+    bool m_committed = false;
+};
+
+using Sha256Digest = array<uint8_t, 32>;
+
+// SHA-256 (FIPS 180-4) of a byte range.
+inline Sha256Digest sha256(ByteSpan data)
+{
+    static constexpr uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    const auto compressBlock = [&](const uint8_t* block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = uint32_t{block[4 * i]} << 24 | uint32_t{block[4 * i + 1]} << 16 | uint32_t{block[4 * i + 2]} << 8 |
+                   block[4 * i + 3];
+        for (int i = 16; i < 64; ++i)
+        {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            const uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        const uint32_t rounds[8] = {a, b, c, d, e, f, g, hh};
+        for (int i = 0; i < 8; ++i)
+            h[i] += rounds[i];
+    };
+
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    const size_t full = data.size() / 64 * 64;
+    for (size_t offset = 0; offset < full; offset += 64)
+        compressBlock(bytes + offset);
+
+    // Padding: a 1 bit, zeros, then the message length in bits, big-endian.
+    uint8_t tail[128] = {};
+    const size_t rest = data.size() - full;
+    memcpy(tail, bytes + full, rest);
+    tail[rest] = 0x80;
+    const size_t tailSize = rest < 56 ? 64 : 128;
+    const uint64_t bits = uint64_t{data.size()} * 8;
+    for (int i = 0; i < 8; ++i)
+        tail[tailSize - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    for (size_t offset = 0; offset < tailSize; offset += 64)
+        compressBlock(tail + offset);
+
+    Sha256Digest digest;
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 4; ++j)
+            digest[4 * i + j] = static_cast<uint8_t>(h[i] >> (24 - 8 * j));
+    return digest;
+}
+
+// Pipeline stage that splits payloads into content-defined chunks (FastCDC gear
+// hashing), skips chunks already stored through this stage and compresses new
+// ones before handing them to the wrapped storage. Chunks are identified by
+// their SHA-256 digest. Every stored chunk object starts with a ChunkHeader
+// carrying that digest, so the backend can be indexed by digest. The object
+// itself is stored as a manifest listing the digest and length of each chunk
+// in order, which is enough to reassemble it. Multipart parts are chunked the
+// same way, one part at a time (no chunk spans two parts), and each part is
+// forwarded as its manifest.
+class DedupStorage : public CloudStorage
+{
+public:
+    struct Options
+    {
+        size_t minChunk = 2 * 1024;
+        size_t avgChunk = 8 * 1024; // Must be a power of two.
+        size_t maxChunk = 64 * 1024;
+    };
+
+    struct ChunkHeader
+    {
+        Sha256Digest digest;
+        uint64_t length;       // Before compression.
+        uint64_t packedLength; // PackBits payload that follows the header.
+    };
+
+    struct ManifestEntry
+    {
+        Sha256Digest digest;
+        uint64_t length;
+    };
+
+    DedupStorage(unique_ptr<CloudStorage> storage, Options options)
+        : m_storage(move(storage)), m_options(options)
+    {
+        if (!has_single_bit(m_options.avgChunk) || m_options.minChunk == 0 ||
+            m_options.minChunk >= m_options.avgChunk || m_options.avgChunk >= m_options.maxChunk)
+            throw invalid_argument("DedupStorage: invalid chunk sizes");
+
+        // Normalized chunking: harder to cut before the average size, easier after.
+        const int bits = countr_zero(m_options.avgChunk);
+        m_maskSmall = topBits(bits + 1);
+        m_maskLarge = topBits(bits - 1);
+    }
+
+    virtual bool uploadContents(const string& content) override { return uploadContents(asBytes(content)); }
+
+    virtual bool uploadContents(ByteSpan content) override
+    {
+        bool ok = true;
+        const vector<ManifestEntry> manifest = storeChunks(content, ok);
+        const ByteSpan manifestBytes = as_bytes(span(manifest));
+        m_bytesSent += manifestBytes.size();
+        return m_storage->uploadContents(manifestBytes) && ok;
+    }
+
+    virtual bool uploadContents(ByteSegments segments) override
+    {
+        // Chunk boundaries depend on the bytes around them, so chunk the joined object.
+        vector<byte> joined;
+        for (const auto& segment : segments)
+            joined.insert(joined.end(), segment.begin(), segment.end());
+        return uploadContents(ByteSpan(joined));
+    }
+
+    // The part's chunks are stored like any others and the part itself goes to
+    // the wrapped storage's multipart handling as the part's manifest.
+    virtual bool uploadPart(uint64_t uploadId, size_t partNumber, ByteSpan part, uint32_t checksum) override
+    {
+        if (partChecksum(part) != checksum)
+            return false;
+        bool ok = true;
+        const vector<ManifestEntry> manifest = storeChunks(part, ok);
+        if (!ok)
+            return false;
+
+        const ByteSpan manifestBytes = as_bytes(span(manifest));
+        const uint32_t manifestChecksum = partChecksum(manifestBytes);
+        m_bytesSent += manifestBytes.size();
+        if (!m_storage->uploadPart(uploadId, partNumber, manifestBytes, manifestChecksum))
+            return false;
+
+        lock_guard<mutex> lock(m_sessionsMutex);
+        vector<uint32_t>& checksums = m_sessions[uploadId];
+        if (checksums.size() <= partNumber)
+            checksums.resize(partNumber + 1);
+        checksums[partNumber] = manifestChecksum;
+        return true;
+    }
+
+    // The wrapped storage received manifests, so it is completed with their checksums.
+    virtual bool completeMultipart(uint64_t uploadId, size_t partCount, span<const uint32_t> checksums) override
+    {
+        vector<uint32_t> forwarded;
+        {
+            lock_guard<mutex> lock(m_sessionsMutex);
+            const auto it = m_sessions.find(uploadId);
+            if (it == m_sessions.end())
+                return false;
+            forwarded = move(it->second);
+            m_sessions.erase(it);
+        }
+        if (checksums.size() != partCount || forwarded.size() != partCount)
+            return false;
+        return m_storage->completeMultipart(uploadId, partCount, forwarded);
+    }
+
+    virtual void abortMultipart(uint64_t uploadId) override
+    {
+        {
+            lock_guard<mutex> lock(m_sessionsMutex);
+            m_sessions.erase(uploadId);
+        }
+        m_storage->abortMultipart(uploadId);
+    }
+
+    virtual int getFreeSpace() override { return m_storage->getFreeSpace(); }
+
+    size_t bytesIn() const { return m_bytesIn; }
+    size_t bytesSent() const { return m_bytesSent; }
+    size_t chunksDeduplicated() const { return m_chunksDeduplicated; }
+
+private:
+    // Stores every chunk of `content` not stored before and returns the
+    // manifest for it. `ok` is cleared if a new chunk was refused.
+    vector<ManifestEntry> storeChunks(ByteSpan content, bool& ok)
+    {
+        vector<ManifestEntry> manifest;
+        while (!content.empty())
+        {
+            const size_t length = nextChunkLength(content);
+            const ByteSpan chunk = content.first(length);
+            content = content.subspan(length);
+
+            const Sha256Digest digest = sha256(chunk);
+            manifest.push_back({digest, chunk.size()});
+            m_bytesIn += chunk.size();
+            if (isStored(digest))
+            {
+                ++m_chunksDeduplicated;
+                continue;
+            }
+
+            const vector<byte> packed = compress(chunk);
+            const ChunkHeader header{digest, chunk.size(), packed.size()};
+            const ByteSpan object[] = {as_bytes(span(&header, 1)), ByteSpan(packed)};
+            m_bytesSent += sizeof(header) + packed.size();
+            // Only a chunk the backend accepted may be skipped later.
+            if (m_storage->uploadContents(ByteSegments(object)))
+                markStored(digest);
+            else
+                ok = false;
+        }
+        return manifest;
+    }
+
+    static uint64_t topBits(int count) { return ~uint64_t{0} << (64 - count); }
+
+    static const array<uint64_t, 256>& gearTable()
+    {
+        static const array<uint64_t, 256> table = [] {
+            array<uint64_t, 256> values{};
+            mt19937_64 gen(0x5eed);
+            for (auto& value : values)
+                value = gen();
+            return values;
+        }();
+        return table;
+    }
+
+    size_t nextChunkLength(ByteSpan data) const
+    {
+        if (data.size() <= m_options.minChunk)
+            return data.size();
+
+        const auto& gear = gearTable();
+        const size_t end = min(data.size(), m_options.maxChunk);
+        const size_t normal = min(end, m_options.avgChunk);
+        uint64_t hash = 0;
+        size_t i = m_options.minChunk;
+        for (; i < normal; ++i)
+        {
+            hash = (hash << 1) + gear[to_integer<uint8_t>(data[i])];
+            if ((hash & m_maskSmall) == 0)
+                return i + 1;
+        }
+        for (; i < end; ++i)
+        {
+            hash = (hash << 1) + gear[to_integer<uint8_t>(data[i])];
+            if ((hash & m_maskLarge) == 0)
+                return i + 1;
+        }
+        return end;
+    }
+
+    struct DigestHash
+    {
+        size_t operator()(const Sha256Digest& digest) const
+        {
+            size_t value;
+            memcpy(&value, digest.data(), sizeof(value));
+            return value;
+        }
+    };
+
+    bool isStored(const Sha256Digest& digest)
+    {
+        lock_guard<mutex> lock(m_indexMutex);
+        return m_index.contains(digest);
+    }
+
+    void markStored(const Sha256Digest& digest)
+    {
+        lock_guard<mutex> lock(m_indexMutex);
+        m_index.insert(digest);
+    }
+
+    // PackBits run-length coding: a control byte n < 128 is followed by n + 1
+    // literals, n >= 128 repeats the next byte n - 126 times.
+    static vector<byte> compress(ByteSpan data)
+    {
+        vector<byte> out;
+        out.reserve(data.size() + data.size() / 128 + 1);
+        size_t i = 0;
+        while (i < data.size())
+        {
+            size_t run = 1;
+            while (i + run < data.size() && run < 129 && data[i + run] == data[i])
+                ++run;
+            if (run >= 3)
+            {
+                out.push_back(static_cast<byte>(run + 126));
+                out.push_back(data[i]);
+                i += run;
+                continue;
+            }
+            size_t literals = 0;
+            while (i + literals < data.size() && literals < 128)
+            {
+                if (i + literals + 2 < data.size() && data[i + literals] == data[i + literals + 1] &&
+                    data[i + literals] == data[i + literals + 2])
+                    break;
+                ++literals;
+            }
+            out.push_back(static_cast<byte>(literals - 1));
+            out.insert(out.end(), data.begin() + i, data.begin() + i + literals);
+            i += literals;
+        }
+        return out;
+    }
+
+    unique_ptr<CloudStorage> m_storage;
+    const Options m_options;
+    uint64_t m_maskSmall = 0;
+    uint64_t m_maskLarge = 0;
+    mutex m_indexMutex;
+    unordered_set<Sha256Digest, DigestHash> m_index;
+    mutex m_sessionsMutex;
+    unordered_map<uint64_t, vector<uint32_t>> m_sessions; // Manifest checksums of the parts sent so far
+    atomic<size_t> m_bytesIn{0};
+    atomic<size_t> m_bytesSent{0};
+    atomic<size_t> m_chunksDeduplicated{0};
+};
+
+// CloudStorage that spreads uploads across several backends. Each upload picks
+// two random backends (power of two choices) and keeps the one with the lower
+// expected cost, weighing observed latency, in-flight uploads and free space.
+class PlacementScheduler : public CloudStorage
+{
+public:
+    explicit PlacementScheduler(vector<unique_ptr<CloudStorage>> backends)
+    {
+        if (backends.empty())
+            throw invalid_argument("PlacementScheduler needs at least one backend");
+        for (auto& backend : backends)
+            m_backends.push_back(make_unique<Backend>(move(backend)));
+    }
+
+    virtual bool uploadContents(const string& content) override
+    {
+        return place([&](CloudStorage& storage) { return storage.uploadContents(content); });
+    }
+
+    virtual bool uploadContents(ByteSpan content) override
+    {
+        return place([&](CloudStorage& storage) { return storage.uploadContents(content); });
+    }
+
+    virtual bool uploadContents(ByteSegments segments) override
+    {
+        return place([&](CloudStorage& storage) { return storage.uploadContents(segments); });
+    }
+
+    // The first part of a session picks a backend like any other upload; the
+    // rest of the session, and its completion, follow it there so that
+    // backend's own multipart handling sees the whole session.
+    virtual bool uploadPart(uint64_t uploadId, size_t partNumber, ByteSpan part, uint32_t checksum) override
+    {
+        Backend* backend = sessionBackend(uploadId);
+        if (!backend)
+        {
+            logMessage(LogLevel::Warning, "PlacementScheduler: no backend has free space for upload ", uploadId);
+            return false;
+        }
+        return uploadTo(*backend, [&](CloudStorage& storage) {
+            return storage.uploadPart(uploadId, partNumber, part, checksum);
+        });
+    }
+
+    virtual bool completeMultipart(uint64_t uploadId, size_t partCount, span<const uint32_t> checksums) override
+    {
+        Backend* backend = endSession(uploadId);
+        return backend && backend->storage->completeMultipart(uploadId, partCount, checksums);
+    }
+
+    virtual void abortMultipart(uint64_t uploadId) override
+    {
+        if (Backend* backend = endSession(uploadId))
+            backend->storage->abortMultipart(uploadId);
+    }
+
+    virtual int getFreeSpace() override
+    {
+        int total = 0;
+        for (const auto& backend : m_backends)
+            total += backend->storage->getFreeSpace();
+        return total;
+    }
+
+    // Number of uploads placed on each backend, in construction order.
+    vector<size_t> placements() const
+    {
+        vector<size_t> counts;
+        for (const auto& backend : m_backends)
+            counts.push_back(backend->placed);
+        return counts;
+    }
+
 private:
-    // Generates a unique ID based on the current time.
-    int generateUID()
+    struct Backend
+    {
+        explicit Backend(unique_ptr<CloudStorage> s) : storage(move(s)) {}
+
+        unique_ptr<CloudStorage> storage;
+        atomic<int> inFlight{0};
+        atomic<double> latencyMicros{1.0}; // Exponentially weighted moving average.
+        atomic<size_t> placed{0};
+    };
+
+    // Lower is better; backends without free space are never preferred.
+    static double cost(Backend& backend)
     {
-        const time_t result = time(nullptr); // Get current time in seconds since the Epoch.
-        return static_cast<int>(result); // Return as an integer.
+        const int freeSpace = backend.storage->getFreeSpace();
+        if (freeSpace <= 0)
+            return numeric_limits<double>::infinity();
+        return (backend.inFlight + 1) * backend.latencyMicros / freeSpace;
     }
+
+    // Returns nullptr when no backend has free space.
+    Backend* choose()
+    {
+        if (m_backends.size() > 1)
+        {
+            thread_local mt19937 gen(random_device{}());
+            uniform_int_distribution<size_t> dis(0, m_backends.size() - 1);
+            const size_t first = dis(gen);
+            size_t second = dis(gen);
+            while (second == first)
+                second = dis(gen);
+
+            Backend& a = *m_backends[first];
+            Backend& b = *m_backends[second];
+            const double costA = cost(a);
+            const double costB = cost(b);
+            if (min(costA, costB) < numeric_limits<double>::infinity())
+                return costA <= costB ? &a : &b;
+        }
+
+        // Both samples are full (or there is only one backend): take the cheapest one with space.
+        Backend* best = nullptr;
+        double bestCost = numeric_limits<double>::infinity();
+        for (const auto& backend : m_backends)
+        {
+            const double backendCost = cost(*backend);
+            if (backendCost < bestCost)
+            {
+                best = backend.get();
+                bestCost = backendCost;
+            }
+        }
+        return best;
+    }
+
+    // The backend a multipart session was placed on, choosing one for its
+    // first part. Returns nullptr, and remembers nothing, if none has space.
+    Backend* sessionBackend(uint64_t uploadId)
+    {
+        lock_guard<mutex> lock(m_sessionsMutex);
+        if (const auto it = m_sessions.find(uploadId); it != m_sessions.end())
+            return it->second;
+        Backend* backend = choose();
+        if (backend)
+            m_sessions.emplace(uploadId, backend);
+        return backend;
+    }
+
+    Backend* endSession(uint64_t uploadId)
+    {
+        lock_guard<mutex> lock(m_sessionsMutex);
+        const auto it = m_sessions.find(uploadId);
+        if (it == m_sessions.end())
+            return nullptr;
+        Backend* backend = it->second;
+        m_sessions.erase(it);
+        return backend;
+    }
+
+    template <typename Upload>
+    bool place(Upload upload)
+    {
+        Backend* chosen = choose();
+        if (!chosen)
+        {
+            logMessage(LogLevel::Warning, "PlacementScheduler: no backend has free space");
+            return false;
+        }
+        return uploadTo(*chosen, upload);
+    }
+
+    template <typename Upload>
+    bool uploadTo(Backend& backend, Upload upload)
+    {
+        ++backend.inFlight;
+        const auto start = chrono::steady_clock::now();
+        const bool ok = upload(*backend.storage);
+        const chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+        --backend.inFlight;
+        ++backend.placed;
+
+        constexpr double smoothing = 0.2;
+        backend.latencyMicros = (1.0 - smoothing) * backend.latencyMicros + smoothing * elapsed.count();
+        return ok;
+    }
+
+    vector<unique_ptr<Backend>> m_backends;
+    mutex m_sessionsMutex;
+    unordered_map<uint64_t, Backend*> m_sessions; // Multipart sessions in progress
 };
 
 // Main function.
-int main()
+int main(int argc, char* argv[])
 {
+    // Run with --bench-ids to measure the ID generator instead of the demo.
+    if (argc > 1 && string_view(argv[1]) == "--bench-ids")
+    {
+        benchmarkUniqueIds(20'000'000);
+        return 0;
+    }
+
+    // Show the adapters' call tracing in this demo; production runs stay at Info.
+    Logger::instance().setLevel(LogLevel::Debug);
+
     // Create an array of pointers to CloudStorage objects.
     const unique_ptr<CloudStorage> cloudServices[] = {
         make_unique<CloudDrive>(),
@@ -121,15 +1517,85 @@ int main()
         make_unique<VirtualDriveAdapter>()
     };
 
-    // Sample content to upload.
-    const string content = "Beam me up, Scotty!";
+    // Sample contents to upload.
+    const vector<string> contents = {
+        "Beam me up, Scotty!",
+        "Make it so.",
+        "Live long and prosper."
+    };
+
+    // Upload a header and a body kept in separate buffers as one object, without joining them.
+    const string header = "HDR:";
+    const string body = "Engage!";
+    const ByteSpan segments[] = { asBytes(header), asBytes(body) };
+    for (const auto& service : cloudServices)
+        service->uploadContents(ByteSegments(segments));
+    logMessage(LogLevel::Info);
+
+    // Fan the batch out to every service through the shared upload pool.
+    UploadPool pool(4, 8);
+    vector<future<bool>> uploads;
+    for (const auto& service : cloudServices)
+    {
+        auto batch = pool.submitBatch(*service, contents);
+        move(batch.begin(), batch.end(), back_inserter(uploads));
+    }
+
+    size_t succeeded = 0;
+    for (auto& upload : uploads)
+        succeeded += upload.get() ? 1 : 0;
+    logMessage(LogLevel::Info, succeeded, " of ", uploads.size(), " uploads succeeded");
+    logMessage(LogLevel::Info);
+
+    // Stream a larger object to VirtualDrive in small parts.
+    VirtualDriveAdapter virtualDrive;
+    MultipartUpload session(virtualDrive, { .partSize = 16, .concurrency = 2, .maxAttempts = 3 }, pool);
+    for (const auto& content : contents)
+        session.write(asBytes(content));
+    const bool committed = session.commit();
+    logMessage(LogLevel::Info, "Multipart upload ", session.uploadId(), " sent ", session.partCount(),
+               " parts, committed: ", boolalpha, committed);
+    logMessage(LogLevel::Info);
+
+    // Back up the same document twice; the second pass only sends a manifest.
+    DedupStorage dedupDrive(make_unique<FastShare>(), { .minChunk = 64, .avgChunk = 256, .maxChunk = 1024 });
+    string document;
+    for (int line = 0; line < 64; ++line)
+        document += "Captain's log, stardate " + to_string(41000 + line * 7) + ". All quiet.          \n";
+    dedupDrive.uploadContents(document);
+    dedupDrive.uploadContents(document);
+    logMessage(LogLevel::Info, "Dedup stage: ", dedupDrive.bytesIn(), " bytes in, ", dedupDrive.bytesSent(), " bytes sent, ",
+               dedupDrive.chunksDeduplicated(), " chunks deduplicated");
+    logMessage(LogLevel::Info);
+
+    // Let the scheduler spread a stream of objects over cached backends.
+    vector<unique_ptr<CloudStorage>> backends;
+    backends.push_back(make_unique<CachedFreeSpaceStorage>(make_unique<CloudDrive>(), chrono::seconds(1)));
+    backends.push_back(make_unique<CachedFreeSpaceStorage>(make_unique<FastShare>(), chrono::seconds(1)));
+    backends.push_back(make_unique<CachedFreeSpaceStorage>(make_unique<VirtualDriveAdapter>(), chrono::seconds(1)));
+    PlacementScheduler scheduler(move(backends));
+    auto placed = pool.submitBatch(scheduler, contents);
+    for (auto& upload : placed)
+        upload.get();
+    const auto counts = scheduler.placements();
+    logMessage(LogLevel::Info, "Placements - CloudDrive: ", counts[0], ", FastShare: ", counts[1],
+               ", VirtualDrive: ", counts[2]);
+    logMessage(LogLevel::Info);
+
+    // Repeated free-space polls within the TTL are served from the cache.
+    CachedFreeSpaceStorage cachedDrive(make_unique<CloudDrive>(), chrono::seconds(5));
+    for (int i = 0; i < 3; ++i)
+    {
+        const int freeSpace = cachedDrive.getFreeSpace();
+        logMessage(LogLevel::Info, "Cached CloudDrive free space: ", freeSpace, "GB");
+    }
+    logMessage(LogLevel::Info, "Cache hits: ", cachedDrive.hits(), ", misses: ", cachedDrive.misses());
+    logMessage(LogLevel::Info);
 
-    // Iterate through the array and invoke the uploadContents and getFreeSpace methods.
     for (const auto& service : cloudServices)
     {
-        service->uploadContents(content);
         service->getFreeSpace();
-        cout << endl;
+        logMessage(LogLevel::Info);
     }
 
     return 0;
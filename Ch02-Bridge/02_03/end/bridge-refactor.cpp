@@ -1,5 +1,24 @@
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <vector>
+#include <stdexcept>
+#include <span>
+#include <istream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <deque>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XOR_CIPHER_X86 1
+#endif
 
 using namespace std;
 
@@ -7,6 +26,19 @@ class ITextHandler
 {
 public:
   virtual string prepareMessage(const string &text) const = 0;
+
+  // Streaming form: transforms one chunk that starts at byte `position` of the
+  // message. Returns either `input` itself or the part of `output` it wrote;
+  // `output` has room for input.size() + maxExpansion() bytes.
+  virtual string_view transformChunk(string_view input, span<char> output, size_t position) const = 0;
+
+  // Most bytes a single chunk can grow by, e.g. for a header.
+  virtual size_t maxExpansion() const { return 0; }
+
+  // Where the output of the chunk starting at input `position` starts in the
+  // transformed stream.
+  virtual size_t outputPosition(size_t position) const { return position; }
+
   virtual ~ITextHandler() = default;
 };
 
@@ -21,11 +53,139 @@ public:
     return sharePreparedText(preparedText);
   }
 
+  // Shares a message of any length read from `source`. A reader thread fills
+  // and transforms chunks while this thread hands finished ones to the
+  // transport; at most `depth` chunks are buffered at a time.
+  bool shareStream(istream &source, size_t chunkSize = 64 * 1024, size_t depth = 4)
+  {
+    if (chunkSize == 0 || depth == 0)
+      throw invalid_argument("shareStream needs a non-zero chunk size and depth");
+
+    struct Slot
+    {
+      vector<char> input;
+      vector<char> output;
+      string_view prepared;
+    };
+    vector<Slot> slots(depth);
+    for (auto &slot : slots)
+    {
+      slot.input.resize(chunkSize);
+      slot.output.resize(chunkSize + m_textHandler.maxExpansion());
+    }
+
+    mutex slotsMutex;
+    condition_variable slotsChanged;
+    size_t produced = 0, consumed = 0;
+    bool finished = false;
+    bool cancelled = false;
+    exception_ptr readerError;
+
+    thread reader([&] {
+      try
+      {
+        for (size_t position = 0;;)
+        {
+          {
+            unique_lock<mutex> lock(slotsMutex);
+            slotsChanged.wait(lock, [&] { return produced - consumed < depth || cancelled; });
+            if (cancelled)
+              break;
+          }
+          Slot &slot = slots[produced % depth];
+          source.read(slot.input.data(), static_cast<streamsize>(chunkSize));
+          const size_t size = static_cast<size_t>(source.gcount());
+          if (size == 0)
+            break;
+          slot.prepared = m_textHandler.transformChunk(string_view(slot.input.data(), size), slot.output, position);
+          position += size;
+          {
+            lock_guard<mutex> lock(slotsMutex);
+            ++produced;
+          }
+          slotsChanged.notify_all();
+        }
+      }
+      catch (...)
+      {
+        readerError = current_exception();
+      }
+      {
+        lock_guard<mutex> lock(slotsMutex);
+        finished = true;
+      }
+      slotsChanged.notify_all();
+    });
+
+    bool ok = true;
+    try
+    {
+      for (;;)
+      {
+        {
+          unique_lock<mutex> lock(slotsMutex);
+          slotsChanged.wait(lock, [&] { return consumed < produced || finished; });
+          if (consumed == produced)
+            break;
+        }
+        ok = sharePreparedChunk(slots[consumed % depth].prepared) && ok;
+        {
+          lock_guard<mutex> lock(slotsMutex);
+          ++consumed;
+        }
+        slotsChanged.notify_all();
+      }
+    }
+    catch (...)
+    {
+      // The transport failed: stop the reader before the slots go away.
+      {
+        lock_guard<mutex> lock(slotsMutex);
+        cancelled = true;
+      }
+      slotsChanged.notify_all();
+      reader.join();
+      try
+      {
+        finishStream();
+      }
+      catch (...)
+      {
+      }
+      throw;
+    }
+    reader.join();
+
+    ok = finishStream() && ok;
+    if (readerError)
+      rethrow_exception(readerError);
+    return ok;
+  }
+
   virtual ~ITextSharer() = default;
 
 protected:
   virtual bool sharePreparedText(const string &text) = 0;
 
+  string prepareText(const string &text) const
+  {
+    return m_textHandler.prepareMessage(text);
+  }
+
+  // Sends one chunk of a streamed message. Transports without chunked
+  // delivery send each chunk as a message of its own.
+  virtual bool sharePreparedChunk(string_view chunk)
+  {
+    return sharePreparedText(string(chunk));
+  }
+
+  // Called after the last chunk of a stream. Transports that send chunks
+  // without waiting report here whether all of them were delivered.
+  virtual bool finishStream()
+  {
+    return true;
+  }
+
 private:
   const ITextHandler &m_textHandler;
 };
@@ -38,23 +198,167 @@ public:
     cout << "PlainTextHandler::prepareMessage() returning original text..." << endl;
     return text;
   }
+
+  // Pass-through: the chunk is handed on without being copied.
+  string_view transformChunk(string_view input, span<char>, size_t) const override
+  {
+    return input;
+  }
+
+  // Static-bridge form: returns a view of the input, nothing is copied.
+  string_view prepare(string_view text, string &) const
+  {
+    return text;
+  }
 };
 
 class EmailShare : public ITextSharer
 {
 public:
-  explicit EmailShare(const PlainTextHandler &handler) : ITextSharer(handler) {}
+  explicit EmailShare(const ITextHandler &handler) : ITextSharer(handler) {}
 
   bool sharePreparedText(const string &text) override
   {
     cout << "EmailShare::shareText() sharing text: " << text << endl;
     return true;
   }
+
+protected:
+  bool sharePreparedChunk(string_view chunk) override
+  {
+    cout << "EmailShare::sharePreparedChunk() sending " << chunk.size() << " bytes: " << chunk << endl;
+    return true;
+  }
+};
+
+// Repeating-key XOR cipher with SSE2, AVX2 and AVX-512 kernels chosen at run
+// time from what the CPU supports, plus a portable scalar fallback. Input and
+// output may be the same buffer, which encrypts in place.
+class XorCipher
+{
+public:
+  using Kernel = void (*)(const char *input, char *output, size_t size, const char *keyStream, size_t keySize);
+
+  explicit XorCipher(string key) : m_key(move(key))
+  {
+    if (m_key.empty())
+      throw invalid_argument("XorCipher needs a non-empty key");
+    // keyStream[offset .. offset + 64) is the key as seen from any block starting
+    // at key position offset, so the kernels load their key vectors directly.
+    // The extra key length lets a stream start at any key position.
+    m_keyStream.resize(2 * m_key.size() + maxVectorWidth);
+    for (size_t i = 0; i < m_keyStream.size(); ++i)
+      m_keyStream[i] = m_key[i % m_key.size()];
+  }
+
+  void apply(string_view input, char *output) const
+  {
+    apply(kernel(), input, output);
+  }
+
+  // Encrypts bytes that sit at `position` within a longer stream.
+  void apply(string_view input, char *output, size_t position) const
+  {
+    apply(kernel(), input, output, position);
+  }
+
+  void apply(Kernel kernel, string_view input, char *output, size_t position = 0) const
+  {
+    kernel(input.data(), output, input.size(), m_keyStream.data() + position % m_key.size(), m_key.size());
+  }
+
+  static Kernel kernel()
+  {
+    static const Kernel selected = selectKernel();
+    return selected;
+  }
+
+  static void scalarKernel(const char *input, char *output, size_t size, const char *keyStream, size_t keySize)
+  {
+    size_t offset = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+      output[i] = input[i] ^ keyStream[offset];
+      if (++offset == keySize)
+        offset = 0;
+    }
+  }
+
+#ifdef XOR_CIPHER_X86
+  __attribute__((target("sse2"))) static void sse2Kernel(const char *input, char *output, size_t size,
+                                                         const char *keyStream, size_t keySize)
+  {
+    size_t i = 0, offset = 0;
+    for (; i + 16 <= size; i += 16, offset = (offset + 16) % keySize)
+    {
+      const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keyStream + offset));
+      const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_xor_si128(data, key));
+    }
+    xorTail(input + i, output + i, size - i, keyStream + offset);
+  }
+
+  __attribute__((target("avx2"))) static void avx2Kernel(const char *input, char *output, size_t size,
+                                                         const char *keyStream, size_t keySize)
+  {
+    size_t i = 0, offset = 0;
+    for (; i + 32 <= size; i += 32, offset = (offset + 32) % keySize)
+    {
+      const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keyStream + offset));
+      const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_xor_si256(data, key));
+    }
+    xorTail(input + i, output + i, size - i, keyStream + offset);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512Kernel(const char *input, char *output, size_t size,
+                                                              const char *keyStream, size_t keySize)
+  {
+    size_t i = 0, offset = 0;
+    for (; i + 64 <= size; i += 64, offset = (offset + 64) % keySize)
+    {
+      const __m512i key = _mm512_loadu_si512(keyStream + offset);
+      const __m512i data = _mm512_loadu_si512(input + i);
+      _mm512_storeu_si512(output + i, _mm512_xor_si512(data, key));
+    }
+    xorTail(input + i, output + i, size - i, keyStream + offset);
+  }
+#endif
+
+private:
+  static constexpr size_t maxVectorWidth = 64;
+
+  // The last partial vector: fewer than 64 bytes, all covered by the key stream.
+  static void xorTail(const char *input, char *output, size_t size, const char *key)
+  {
+    for (size_t i = 0; i < size; ++i)
+      output[i] = input[i] ^ key[i];
+  }
+
+  static Kernel selectKernel()
+  {
+#ifdef XOR_CIPHER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return avx512Kernel;
+    if (__builtin_cpu_supports("avx2"))
+      return avx2Kernel;
+    if (__builtin_cpu_supports("sse2"))
+      return sse2Kernel;
+#endif
+    return scalarKernel;
+  }
+
+  string m_key;
+  string m_keyStream;
 };
 
 class EncryptedTextHandler : public ITextHandler
 {
 public:
+  EncryptedTextHandler() : EncryptedTextHandler("@") {}
+  explicit EncryptedTextHandler(string key) : m_cipher(move(key)) {}
+
   string prepareMessage(const string &text) const override
   {
     cout << "EncryptedTextHandler::prepareMessage() encrypting text..." << endl;
@@ -62,17 +366,34 @@ public:
     return encrypted;
   }
 
-private:
-  string xorEncrypt(const string &input) const
+  string_view transformChunk(string_view input, span<char> output, size_t position) const override
+  {
+    m_cipher.apply(input, output.data(), position);
+    return string_view(output.data(), input.size());
+  }
+
+  // Static-bridge form: encrypts into the caller's reusable buffer.
+  string_view prepare(string_view text, string &scratch) const
   {
-    char key = 64;
-    string output = input;
+    scratch.resize(text.size());
+    xorInto(text, scratch.data());
+    return scratch;
+  }
 
-    for (int i = 0; i < input.size(); ++i)
-      output[i] = input[i] ^ key;
+private:
+  void xorInto(string_view input, char *output) const
+  {
+    m_cipher.apply(input, output);
+  }
 
+  string xorEncrypt(const string &input) const
+  {
+    string output(input.size(), '\0');
+    xorInto(input, output.data());
     return output;
   }
+
+  XorCipher m_cipher;
 };
 
 class EmailShareEncrypted : public ITextSharer
@@ -86,10 +407,475 @@ protected:
     cout << "EmailShareEncrypted::shareText() sharing text: " << text << endl;
     return true;
   }
+
+  bool sharePreparedChunk(string_view chunk) override
+  {
+    cout << "EmailShareEncrypted::sharePreparedChunk() sending " << chunk.size() << " bytes: " << chunk << endl;
+    return true;
+  }
+};
+
+class SMSShare : public ITextSharer
+{
+public:
+  explicit SMSShare(const ITextHandler &handler) : ITextSharer(handler) {}
+
+protected:
+  bool sharePreparedText(const string &text) override
+  {
+    cout << "SMSShare::shareText() sharing text: " << text << endl;
+    return true;
+  }
+};
+
+// Destination that delivers a whole batch of messages at once and reports a
+// result per message.
+class IBatchSink
+{
+public:
+  virtual vector<bool> sendBatch(const vector<string> &messages) = 0;
+  virtual ~IBatchSink() = default;
+};
+
+// Local stand-in for a bulk notification endpoint.
+class ConsoleBatchSink : public IBatchSink
+{
+public:
+  vector<bool> sendBatch(const vector<string> &messages) override
+  {
+    cout << "ConsoleBatchSink::sendBatch() sending " << messages.size() << " messages:" << endl;
+    for (const auto &message : messages)
+      cout << "  " << message << endl;
+    return vector<bool>(messages.size(), true);
+  }
+};
+
+// Collects messages and hands them to the sink in batches. A batch is sent as
+// soon as it reaches maxMessages or maxBytes, or once its oldest message has
+// waited maxDelay. Every message gets its own future for its result.
+class MessageBatcher
+{
+public:
+  struct Policy
+  {
+    size_t maxMessages = 64;
+    size_t maxBytes = 64 * 1024;
+    chrono::milliseconds maxDelay{5};
+  };
+
+  MessageBatcher(IBatchSink &sink, Policy policy)
+      : m_sink(sink), m_policy(policy), m_flusher([this] { flushLoop(); }) {}
+
+  MessageBatcher(const MessageBatcher &) = delete;
+  MessageBatcher &operator=(const MessageBatcher &) = delete;
+
+  ~MessageBatcher()
+  {
+    {
+      lock_guard<mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_changed.notify_all();
+    m_flusher.join();
+  }
+
+  future<bool> enqueue(string message)
+  {
+    promise<bool> result;
+    future<bool> delivery = result.get_future();
+    {
+      lock_guard<mutex> lock(m_mutex);
+      if (m_messages.empty())
+        m_deadline = chrono::steady_clock::now() + m_policy.maxDelay;
+      m_bytes += message.size();
+      m_messages.push_back(move(message));
+      m_results.push_back(move(result));
+    }
+    m_changed.notify_all();
+    return delivery;
+  }
+
+private:
+  bool batchFull() const
+  {
+    return m_messages.size() >= m_policy.maxMessages || m_bytes >= m_policy.maxBytes;
+  }
+
+  void flushLoop()
+  {
+    unique_lock<mutex> lock(m_mutex);
+    for (;;)
+    {
+      if (m_messages.empty())
+      {
+        if (m_stopping)
+          return;
+        m_changed.wait(lock, [this] { return m_stopping || !m_messages.empty(); });
+        continue;
+      }
+      if (!m_stopping && !batchFull() && chrono::steady_clock::now() < m_deadline)
+      {
+        m_changed.wait_until(lock, m_deadline, [this] { return m_stopping || batchFull(); });
+        continue;
+      }
+
+      vector<string> messages = move(m_messages);
+      vector<promise<bool>> results = move(m_results);
+      m_messages.clear();
+      m_results.clear();
+      m_bytes = 0;
+      lock.unlock();
+
+      try
+      {
+        const vector<bool> sent = m_sink.sendBatch(messages);
+        for (size_t i = 0; i < results.size(); ++i)
+          results[i].set_value(i < sent.size() && sent[i]);
+      }
+      catch (...)
+      {
+        for (auto &result : results)
+          result.set_exception(current_exception());
+      }
+      lock.lock();
+    }
+  }
+
+  IBatchSink &m_sink;
+  const Policy m_policy;
+  mutex m_mutex;
+  condition_variable m_changed;
+  vector<string> m_messages;
+  vector<promise<bool>> m_results;
+  size_t m_bytes = 0;
+  chrono::steady_clock::time_point m_deadline;
+  bool m_stopping = false;
+  thread m_flusher;
 };
 
-int main()
+// ITextSharer whose transport batches messages. shareTextAsync() returns
+// without waiting for delivery; shareText() still blocks for its own result.
+// shareStream() queues every chunk without waiting and collects the results
+// after the last one, so chunks share batches; streams through one sharer
+// must not overlap.
+class BatchingShare : public ITextSharer
 {
+public:
+  BatchingShare(const ITextHandler &handler, IBatchSink &sink, MessageBatcher::Policy policy)
+      : ITextSharer(handler), m_batcher(sink, policy) {}
+
+  future<bool> shareTextAsync(const string &text)
+  {
+    return m_batcher.enqueue(prepareText(text));
+  }
+
+protected:
+  bool sharePreparedText(const string &text) override
+  {
+    return m_batcher.enqueue(text).get();
+  }
+
+  bool sharePreparedChunk(string_view chunk) override
+  {
+    m_streamed.push_back(m_batcher.enqueue(string(chunk)));
+    return true;
+  }
+
+  bool finishStream() override
+  {
+    vector<future<bool>> streamed = move(m_streamed);
+    m_streamed.clear();
+    bool ok = true;
+    for (auto &delivery : streamed)
+      ok = delivery.get() && ok;
+    return ok;
+  }
+
+private:
+  MessageBatcher m_batcher;
+  vector<future<bool>> m_streamed;
+};
+
+// Marks a message as expiring by prefixing it with an expiry header.
+class ExpiringTextHandler : public ITextHandler
+{
+public:
+  explicit ExpiringTextHandler(const string &expiry) : m_header("[expires in " + expiry + "] ") {}
+
+  string prepareMessage(const string &text) const override
+  {
+    cout << "ExpiringTextHandler::prepareMessage() adding expiry header..." << endl;
+    return m_header + text;
+  }
+
+  string_view transformChunk(string_view input, span<char> output, size_t position) const override
+  {
+    if (position != 0)
+      return input;
+    copy(m_header.begin(), m_header.end(), output.begin());
+    copy(input.begin(), input.end(), output.begin() + m_header.size());
+    return string_view(output.data(), m_header.size() + input.size());
+  }
+
+  size_t maxExpansion() const override { return m_header.size(); }
+  size_t outputPosition(size_t position) const override { return position == 0 ? 0 : position + m_header.size(); }
+
+private:
+  string m_header;
+};
+
+// Runs several handlers as one. Instead of materializing the whole message
+// after every stage, the message is pushed through all stages one block at a
+// time, with two block-sized buffers alternating as stage input and output.
+// This replaces a subclass per combination (EmailShareAutoExpiring,
+// SMSShareEncrypted, ...) with a chain picked at run time.
+class HandlerChain : public ITextHandler
+{
+public:
+  explicit HandlerChain(vector<const ITextHandler *> stages, size_t blockSize = 16 * 1024)
+      : m_stages(move(stages)), m_blockSize(blockSize)
+  {
+    if (m_blockSize == 0)
+      throw invalid_argument("HandlerChain needs a non-zero block size");
+  }
+
+  string prepareMessage(const string &text) const override
+  {
+    cout << "HandlerChain::prepareMessage() running " << m_stages.size() << " stages in one pass..." << endl;
+    string prepared;
+    prepared.reserve(text.size() + maxExpansion());
+    vector<char> block(m_blockSize + maxExpansion());
+    size_t position = 0;
+    do
+    {
+      const string_view input = string_view(text).substr(position, m_blockSize);
+      prepared.append(transformChunk(input, block, position));
+      position += input.size();
+    } while (position < text.size());
+    return prepared;
+  }
+
+  string_view transformChunk(string_view input, span<char> output, size_t position) const override
+  {
+    const ScratchLevel level;
+    vector<char> &scratch = *level.buffer;
+    scratch.resize(input.size() + maxExpansion());
+
+    string_view current = input;
+    for (const ITextHandler *stage : m_stages)
+    {
+      // Write into whichever buffer does not hold the current data.
+      const span<char> target = current.data() == output.data() ? span<char>(scratch) : output;
+      current = stage->transformChunk(current, target, position);
+      position = stage->outputPosition(position);
+    }
+    if (current.data() == scratch.data())
+    {
+      copy(current.begin(), current.end(), output.begin());
+      current = string_view(output.data(), current.size());
+    }
+    return current;
+  }
+
+  size_t maxExpansion() const override
+  {
+    size_t expansion = 0;
+    for (const ITextHandler *stage : m_stages)
+      expansion += stage->maxExpansion();
+    return expansion;
+  }
+
+  size_t outputPosition(size_t position) const override
+  {
+    for (const ITextHandler *stage : m_stages)
+      position = stage->outputPosition(position);
+    return position;
+  }
+
+private:
+  // Claims this thread's scratch buffer for the current nesting depth, so a
+  // chain running as a stage of another chain never writes into, or resizes,
+  // a buffer its caller is still using.
+  struct ScratchLevel
+  {
+    ScratchLevel()
+    {
+      if (t_depth == t_scratch.size())
+        t_scratch.emplace_back();
+      buffer = &t_scratch[t_depth++];
+    }
+    ~ScratchLevel() { --t_depth; }
+
+    vector<char> *buffer;
+  };
+
+  inline static thread_local deque<vector<char>> t_scratch;
+  inline static thread_local size_t t_depth = 0;
+
+  vector<const ITextHandler *> m_stages;
+  size_t m_blockSize;
+};
+
+// Compile-time bridge: the handler and the transport are template parameters,
+// so shareText() has no virtual calls and reuses one buffer for every message.
+// ITextSharer remains the runtime-polymorphic form when the pairing is only
+// known at run time.
+template <typename Handler, typename Transport>
+class TextSharer
+{
+public:
+  explicit TextSharer(Handler handler = {}, Transport transport = {})
+      : m_handler(move(handler)), m_transport(move(transport)) {}
+
+  bool shareText(string_view text)
+  {
+    return m_transport.send(m_handler.prepare(text, m_scratch));
+  }
+
+  Transport &transport() { return m_transport; }
+
+private:
+  Handler m_handler;
+  Transport m_transport;
+  string m_scratch;
+};
+
+class EmailTransport
+{
+public:
+  bool send(string_view text)
+  {
+    cout << "EmailTransport::send() sharing text: " << text << endl;
+    return true;
+  }
+};
+
+// Transport that only counts what it is given; used by the benchmark.
+class CountingTransport
+{
+public:
+  bool send(string_view text)
+  {
+    ++messages;
+    bytes += text.size();
+    return true;
+  }
+
+  size_t messages = 0;
+  size_t bytes = 0;
+};
+
+// Runtime-bridge counterparts of the above, without console output.
+class SilentEncryptedHandler : public ITextHandler
+{
+public:
+  string prepareMessage(const string &text) const override
+  {
+    string output;
+    m_handler.prepare(text, output);
+    return output;
+  }
+
+  string_view transformChunk(string_view input, span<char> output, size_t position) const override
+  {
+    return m_handler.transformChunk(input, output, position);
+  }
+
+private:
+  EncryptedTextHandler m_handler;
+};
+
+class CountingShare : public ITextSharer
+{
+public:
+  explicit CountingShare(const ITextHandler &handler) : ITextSharer(handler) {}
+
+  size_t messages = 0;
+  size_t bytes = 0;
+
+protected:
+  bool sharePreparedText(const string &text) override
+  {
+    ++messages;
+    bytes += text.size();
+    return true;
+  }
+};
+
+// Compares messages/sec of the runtime and compile-time bridges on short messages.
+void benchmarkBridges(size_t messageCount)
+{
+  using Clock = chrono::steady_clock;
+  const string message = "Beam me up, Scotty!";
+
+  SilentEncryptedHandler handler;
+  CountingShare dynamicSharer(handler);
+  const auto dynamicStart = Clock::now();
+  for (size_t i = 0; i < messageCount; ++i)
+    dynamicSharer.shareText(message);
+  const chrono::duration<double> dynamicTime = Clock::now() - dynamicStart;
+
+  TextSharer<EncryptedTextHandler, CountingTransport> staticSharer;
+  const auto staticStart = Clock::now();
+  for (size_t i = 0; i < messageCount; ++i)
+    staticSharer.shareText(message);
+  const chrono::duration<double> staticTime = Clock::now() - staticStart;
+
+  cout << "ITextSharer (runtime):  " << dynamicSharer.messages / dynamicTime.count() / 1e6 << "M messages/s" << endl;
+  cout << "TextSharer (templated): " << staticSharer.transport().messages / staticTime.count() / 1e6 << "M messages/s"
+       << endl;
+}
+
+// Measures XorCipher throughput in GB/s for each kernel this CPU can run,
+// checking every kernel against the scalar result.
+void benchmarkXorKernels(size_t bufferSize)
+{
+  vector<pair<const char *, XorCipher::Kernel>> kernels = {{"scalar", XorCipher::scalarKernel}};
+#ifdef XOR_CIPHER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    kernels.push_back({"sse2", XorCipher::sse2Kernel});
+  if (__builtin_cpu_supports("avx2"))
+    kernels.push_back({"avx2", XorCipher::avx2Kernel});
+  if (__builtin_cpu_supports("avx512f"))
+    kernels.push_back({"avx512", XorCipher::avx512Kernel});
+#endif
+
+  const XorCipher cipher("rolling-key!");
+  string input(bufferSize, '\0');
+  for (size_t i = 0; i < input.size(); ++i)
+    input[i] = static_cast<char>(i * 31 + 7);
+  string expected(bufferSize, '\0');
+  cipher.apply(XorCipher::scalarKernel, input, expected.data());
+
+  string output(bufferSize, '\0');
+  constexpr int rounds = 10;
+  for (const auto &[name, kernel] : kernels)
+  {
+    const auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+      cipher.apply(kernel, input, output.data());
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << name << ": " << rounds * bufferSize / elapsed.count() / 1e9 << " GB/s"
+         << (output == expected ? "" : " (MISMATCH)") << endl;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  // Run with --bench to compare the runtime and compile-time bridges.
+  if (argc > 1 && string_view(argv[1]) == "--bench")
+  {
+    benchmarkBridges(10'000'000);
+    return 0;
+  }
+  // Run with --bench-xor to measure the encryption kernels.
+  if (argc > 1 && string_view(argv[1]) == "--bench-xor")
+  {
+    benchmarkXorKernels(64 * 1024 * 1024 + 13);
+    return 0;
+  }
+
   PlainTextHandler handler = PlainTextHandler();
   EncryptedTextHandler encryptHandler = EncryptedTextHandler();
 
@@ -108,5 +894,42 @@ int main()
     cout << endl;
   }
 
+  // Stream a message through both bridges in small chunks.
+  const string longContent = "Space: the final frontier. These are the voyages of the starship Enterprise.";
+  for (const auto &service : sharingServices)
+  {
+    istringstream source(longContent);
+    service->shareStream(source, 32, 2);
+    cout << endl;
+  }
+
+  // Auto-expiring variants as handler chains rather than subclasses.
+  const ExpiringTextHandler expiring("24h");
+  const HandlerChain expiringChain({&expiring});
+  const HandlerChain expiringEncryptedChain({&expiring, &encryptHandler}, 8);
+  EmailShare expiringEmail(expiringEncryptedChain);
+  SMSShare expiringSMS(expiringChain);
+  expiringEmail.shareText(content);
+  expiringSMS.shareText(content);
+  cout << endl;
+
+  // Fan out notifications through a batching transport: two batches of three.
+  ConsoleBatchSink batchSink;
+  BatchingShare batchingShare(handler, batchSink,
+                              {.maxMessages = 3, .maxBytes = 1024, .maxDelay = chrono::milliseconds(20)});
+  vector<future<bool>> deliveries;
+  for (int i = 1; i <= 6; ++i)
+    deliveries.push_back(batchingShare.shareTextAsync("Notification #" + to_string(i)));
+  size_t delivered = 0;
+  for (auto &delivery : deliveries)
+    delivered += delivery.get() ? 1 : 0;
+  cout << delivered << " of " << deliveries.size() << " notifications delivered" << endl << endl;
+
+  // The same pairings composed at compile time.
+  TextSharer<PlainTextHandler, EmailTransport> plainEmail;
+  TextSharer<EncryptedTextHandler, EmailTransport> encryptedEmail;
+  plainEmail.shareText(content);
+  encryptedEmail.shareText(content);
+
   return 0;
 }
\ No newline at end of file
@@ -1,14 +1,39 @@
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <chrono>
+#include <string_view>
+#include <string>
+#include <array>
+#include <future>
+#include <span>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+#include <typeinfo>
+#include <ostream>
 
 using namespace std;
 
-
 class IEngine
 {
 public:
-    virtual void start() const = 0;
+    void start(ostream &out = cout) const
+    {
+        startEngine(out);
+    }
+
     virtual ~IEngine() = default;
+
+protected:
+    virtual void startEngine(ostream &out) const = 0;
 };
 
 
@@ -17,92 +42,561 @@ class IVehicle
 public:
     explicit IVehicle(const IEngine &engine) : m_engine(engine) {}    
 
-    void drive() const
+    void drive(ostream &out = cout) const
     {
-        m_engine.start();
-        driveVehicle();
+        m_engine.start(out);
+        driveVehicle(out);
     }
 
+    const IEngine &engine() const { return m_engine; }
+
     virtual ~IVehicle() = default;
 
 protected:
-    virtual void driveVehicle() const = 0;
+    virtual void driveVehicle(ostream &out) const = 0;
 
 private:
     const IEngine &m_engine;
 };
 
 // Concrete implementation of Gas engine
-class GasEngine : public IEngine
+class GasEngine final : public IEngine
 {
 public:
-    void start() const override
+    void startEngine(ostream &out) const override
     {
-        cout << "Starting gas engine." << endl;
+        out << "Starting gas engine." << endl;
     }
 };
 
 // Concrete implementation of Electric engine
-class ElectricEngine : public IEngine
+class ElectricEngine final : public IEngine
 {
 public:
-    void start() const override
+    void startEngine(ostream &out) const override
     {
-        cout << "Starting electric engine." << endl;
+        out << "Starting electric engine." << endl;
     }
 };
 
 // Concrete implementation of Hybrid engine
-class HybridEngine : public IEngine
+class HybridEngine final : public IEngine
+{
+public:
+    void startEngine(ostream &out) const override
+    {
+        out << "Starting hybrid engine." << endl;
+    }
+};
+
+// Recalibrated Hybrid engine, rolled out at run time in the demo below
+class TunedHybridEngine : public IEngine
+{
+public:
+    void startEngine(ostream &out) const override
+    {
+        out << "Starting hybrid engine (new calibration)." << endl;
+    }
+};
+
+// Engine whose implementation can be replaced while other threads are calling
+// start(). Readers announce the epoch they entered in a per-thread record,
+// which is a couple of stores and loads with no waiting. swap() publishes the
+// new engine, advances the epoch and waits until no reader from an older
+// epoch is still inside before freeing the old engine (epoch-based RCU).
+// Records are shared by all SwappableEngines; a thread takes one on its first
+// read and hands it back when it exits, so any number of threads can come and
+// go.
+class SwappableEngine : public IEngine
 {
 public:
-    void start() const override
+    explicit SwappableEngine(unique_ptr<const IEngine> engine) : m_current(checked(move(engine)).release()) {}
+
+    SwappableEngine(const SwappableEngine &) = delete;
+    SwappableEngine &operator=(const SwappableEngine &) = delete;
+
+    ~SwappableEngine()
+    {
+        delete m_current.load();
+    }
+
+    void swap(unique_ptr<const IEngine> replacement)
+    {
+        lock_guard<mutex> lock(m_writerMutex);
+        const IEngine *old = m_current.exchange(checked(move(replacement)).release());
+        const uint64_t epoch = s_epoch.fetch_add(1) + 1;
+        for (const ReaderRecord *record = s_records.load(); record; record = record->next)
+        {
+            uint64_t entered = record->epoch.load();
+            while (entered != idle && entered < epoch)
+            {
+                this_thread::yield();
+                entered = record->epoch.load();
+            }
+        }
+        delete old;
+    }
+
+protected:
+    void startEngine(ostream &out) const override
+    {
+        ReadGuard guard(*this);
+        guard.engine->start(out);
+    }
+
+private:
+    static constexpr uint64_t idle = 0;
+
+    // Records are only ever added to the list and reused, never freed, so
+    // swap() can walk it without locks while threads start and exit.
+    struct alignas(64) ReaderRecord
+    {
+        atomic<uint64_t> epoch{idle};
+        atomic<bool> inUse{true};
+        ReaderRecord *next = nullptr;
+        unsigned nesting = 0; // Only touched by the owning thread
+    };
+
+    // Holds a record for the lifetime of the calling thread.
+    struct RecordLease
+    {
+        RecordLease() : record(acquireRecord()) {}
+
+        ~RecordLease()
+        {
+            record->epoch.store(idle);
+            record->inUse.store(false, memory_order_release);
+        }
+
+        ReaderRecord *record;
+    };
+
+    // A thread reading one engine from inside another keeps the epoch of its
+    // outermost read, which only makes writers wait a little longer.
+    struct ReadGuard
+    {
+        explicit ReadGuard(const SwappableEngine &owner) : record(threadRecord())
+        {
+            if (record.nesting++ == 0)
+                record.epoch.store(s_epoch.load());
+            engine = owner.m_current.load();
+        }
+
+        ~ReadGuard()
+        {
+            if (--record.nesting == 0)
+                record.epoch.store(idle, memory_order_release);
+        }
+
+        ReaderRecord &record;
+        const IEngine *engine;
+    };
+
+    static unique_ptr<const IEngine> checked(unique_ptr<const IEngine> engine)
     {
-        cout << "Starting hybrid engine." << endl;
+        if (!engine)
+            throw invalid_argument("SwappableEngine needs an engine");
+        return engine;
     }
+
+    static ReaderRecord &threadRecord()
+    {
+        thread_local RecordLease lease;
+        return *lease.record;
+    }
+
+    static ReaderRecord *acquireRecord()
+    {
+        for (ReaderRecord *record = s_records.load(); record; record = record->next)
+        {
+            bool expected = false;
+            if (!record->inUse.load(memory_order_relaxed) && record->inUse.compare_exchange_strong(expected, true))
+                return record;
+        }
+        auto *record = new ReaderRecord;
+        record->next = s_records.load();
+        while (!s_records.compare_exchange_weak(record->next, record))
+        {
+        }
+        return record;
+    }
+
+    inline static atomic<ReaderRecord *> s_records{nullptr};
+    inline static atomic<uint64_t> s_epoch{1};
+
+    atomic<const IEngine *> m_current;
+    mutex m_writerMutex;
 };
 
 // Concrete implementation of Car
-class Car : public IVehicle
+class Car final : public IVehicle
 {
 public:
     Car(const IEngine &engine) : IVehicle(engine) {}
 
-    void driveVehicle() const override
+    void driveVehicle(ostream &out) const override
     {
-        cout << "Driving a car." << endl;
+        out << "Driving a car." << endl;
     }
 };
 
 // Concrete implementation of Truck
-class Truck : public IVehicle
+class Truck final : public IVehicle
 {
 public:
     Truck(const IEngine &engine) : IVehicle(engine) {}
 
-    void driveVehicle() const override
+    void driveVehicle(ostream &out) const override
     {        
-        cout << "Driving a truck." << endl;
+        out << "Driving a truck." << endl;
     }
 };
 
 // Concrete implementation of Bike
-class Bike : public IVehicle
+class Bike final : public IVehicle
 {
 public:
     Bike(const IEngine &engine) : IVehicle(engine) {}
 
-    void driveVehicle() const override
+    void driveVehicle(ostream &out) const override
     {        
-        cout << "Riding a bike." << endl;
+        out << "Riding a bike." << endl;
+    }
+};
+
+// Data-oriented form of a fleet. Vehicles whose vehicle and engine classes are
+// both one of the final classes above are sorted into buckets by that pair;
+// each bucket keeps typed vehicle and engine columns and drives them with
+// qualified, non-virtual calls the compiler can inline. Any other vehicle,
+// e.g. one on a SwappableEngine, is driven through drive() as usual. Every
+// bucket writes to its own buffer, large fleets run buckets on several
+// threads, and the output is replayed in fleet order, so driveAll() prints
+// exactly what calling drive() on each vehicle in turn would.
+class FleetBatch
+{
+public:
+    void add(const IVehicle &vehicle)
+    {
+        if (!addTyped<Car>(vehicle) && !addTyped<Truck>(vehicle) && !addTyped<Bike>(vehicle))
+        {
+            m_order.push_back({otherBucket, static_cast<uint32_t>(m_others.size())});
+            m_others.push_back(&vehicle);
+        }
+    }
+
+    size_t size() const { return m_order.size(); }
+
+    void driveAll(ostream &out) const
+    {
+        array<BucketOutput, bucketCount> outputs;
+        const unsigned threads = min<unsigned>(thread::hardware_concurrency(), bucketCount);
+        if (m_order.size() < parallelThreshold || threads < 2)
+        {
+            for (size_t index = 0; index < bucketCount; ++index)
+                driveBucket(index, outputs[index]);
+        }
+        else
+        {
+            atomic<size_t> nextBucket{0};
+            vector<jthread> workers;
+            for (unsigned t = 0; t < threads; ++t)
+                workers.emplace_back([&] {
+                    for (size_t index = nextBucket++; index < bucketCount; index = nextBucket++)
+                        driveBucket(index, outputs[index]);
+                });
+        }
+
+        array<string_view, bucketCount> texts;
+        for (size_t index = 0; index < bucketCount; ++index)
+            texts[index] = outputs[index].stream.view();
+        for (const auto &[bucket, row] : m_order)
+        {
+            const vector<size_t> &ends = outputs[bucket].ends;
+            const size_t begin = row == 0 ? 0 : ends[row - 1];
+            out.write(texts[bucket].data() + begin, static_cast<streamsize>(ends[row] - begin));
+        }
+    }
+
+private:
+    template <typename Vehicle, typename Engine>
+    struct Bucket
+    {
+        vector<const Vehicle *> vehicles;
+        vector<const Engine *> engines;
+    };
+
+    template <typename Vehicle>
+    using EngineBuckets = tuple<Bucket<Vehicle, GasEngine>, Bucket<Vehicle, ElectricEngine>, Bucket<Vehicle, HybridEngine>>;
+    using Buckets = decltype(tuple_cat(EngineBuckets<Car>(), EngineBuckets<Truck>(), EngineBuckets<Bike>()));
+
+    static constexpr size_t otherBucket = tuple_size_v<Buckets>;
+    static constexpr size_t bucketCount = otherBucket + 1;
+    static constexpr size_t parallelThreshold = 4096;
+
+    struct BucketOutput
+    {
+        ostringstream stream;
+        vector<size_t> ends; // Where each row's output ends in the stream.
+    };
+
+    struct Entry
+    {
+        size_t bucket;
+        uint32_t row;
+    };
+
+    template <typename Vehicle>
+    bool addTyped(const IVehicle &vehicle)
+    {
+        if (typeid(vehicle) != typeid(Vehicle))
+            return false;
+        const auto &typed = static_cast<const Vehicle &>(vehicle);
+        return addTyped<Vehicle, GasEngine, 0>(typed) || addTyped<Vehicle, ElectricEngine, 1>(typed) ||
+               addTyped<Vehicle, HybridEngine, 2>(typed);
     }
+
+    template <typename Vehicle, typename Engine, size_t EngineIndex>
+    bool addTyped(const Vehicle &vehicle)
+    {
+        const IEngine &engine = vehicle.engine();
+        if (typeid(engine) != typeid(Engine))
+            return false;
+        auto &bucket = get<Bucket<Vehicle, Engine>>(m_buckets);
+        constexpr size_t vehicleIndex = is_same_v<Vehicle, Car> ? 0 : is_same_v<Vehicle, Truck> ? 1 : 2;
+        m_order.push_back({vehicleIndex * 3 + EngineIndex, static_cast<uint32_t>(bucket.vehicles.size())});
+        bucket.vehicles.push_back(&vehicle);
+        bucket.engines.push_back(&static_cast<const Engine &>(engine));
+        return true;
+    }
+
+    void driveBucket(size_t index, BucketOutput &output) const
+    {
+        if (index == otherBucket)
+        {
+            for (const IVehicle *vehicle : m_others)
+            {
+                vehicle->drive(output.stream);
+                output.ends.push_back(static_cast<size_t>(output.stream.tellp()));
+            }
+            return;
+        }
+        [&]<size_t... I>(index_sequence<I...>) {
+            ((I == index ? driveTyped(get<I>(m_buckets), output) : void()), ...);
+        }(make_index_sequence<otherBucket>());
+    }
+
+    // The classes are final, so the qualified calls are resolved at compile time.
+    template <typename Vehicle, typename Engine>
+    static void driveTyped(const Bucket<Vehicle, Engine> &bucket, BucketOutput &output)
+    {
+        for (size_t i = 0; i < bucket.vehicles.size(); ++i)
+        {
+            bucket.engines[i]->Engine::startEngine(output.stream);
+            bucket.vehicles[i]->Vehicle::driveVehicle(output.stream);
+            output.ends.push_back(static_cast<size_t>(output.stream.tellp()));
+        }
+    }
+
+    Buckets m_buckets;
+    vector<const IVehicle *> m_others;
+    vector<Entry> m_order;
+};
+
+// Engines are stateless, so every vehicle can share one instance per engine type.
+template <typename Engine>
+const Engine &sharedEngine()
+{
+    static const Engine engine;
+    return engine;
+}
+
+// Monotonic arena for vehicles. create() bump-allocates from large chunks and
+// reset() destroys every vehicle at once and reuses the chunks, so churning
+// through vehicles costs no heap traffic. An arena is meant to be used by one
+// thread; threadVehicleArena() hands out one per thread.
+class VehicleArena
+{
+public:
+    explicit VehicleArena(size_t chunkSize = 64 * 1024) : m_chunkSize(chunkSize) {}
+
+    VehicleArena(const VehicleArena &) = delete;
+    VehicleArena &operator=(const VehicleArena &) = delete;
+
+    ~VehicleArena()
+    {
+        reset();
+    }
+
+    template <typename Vehicle, typename... Args>
+    Vehicle *create(Args &&...args)
+    {
+        static_assert(is_base_of_v<IVehicle, Vehicle>, "VehicleArena only holds vehicles");
+        // Chunks come from new[], so offsets are only aligned up to its guarantee.
+        static_assert(alignof(Vehicle) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Vehicle is over-aligned for VehicleArena");
+        if (sizeof(Vehicle) > m_chunkSize)
+            throw bad_alloc();
+
+        // Make room first, so that recording the vehicle cannot throw once it exists.
+        if (m_vehicles.size() == m_vehicles.capacity())
+            m_vehicles.reserve(max<size_t>(64, m_vehicles.capacity() * 2));
+        void *storage = allocate(sizeof(Vehicle), alignof(Vehicle));
+        Vehicle *vehicle = new (storage) Vehicle(std::forward<Args>(args)...);
+        m_vehicles.push_back(vehicle);
+        return vehicle;
+    }
+
+    // Destroys all vehicles; previously returned pointers become invalid.
+    void reset()
+    {
+        for (IVehicle *vehicle : m_vehicles)
+            vehicle->~IVehicle();
+        m_vehicles.clear();
+        m_chunkIndex = 0;
+        m_offset = 0;
+    }
+
+    size_t size() const { return m_vehicles.size(); }
+
+private:
+    void *allocate(size_t size, size_t alignment)
+    {
+        for (;;)
+        {
+            if (m_chunkIndex == m_chunks.size())
+                m_chunks.push_back(make_unique<byte[]>(m_chunkSize));
+
+            const size_t aligned = (m_offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + size <= m_chunkSize)
+            {
+                m_offset = aligned + size;
+                return m_chunks[m_chunkIndex].get() + aligned;
+            }
+            ++m_chunkIndex;
+            m_offset = 0;
+        }
+    }
+
+    const size_t m_chunkSize;
+    vector<unique_ptr<byte[]>> m_chunks;
+    size_t m_chunkIndex = 0;
+    size_t m_offset = 0;
+    vector<IVehicle *> m_vehicles;
+};
+
+VehicleArena &threadVehicleArena()
+{
+    thread_local VehicleArena arena;
+    return arena;
+}
+
+// Compares creating and destroying vehicles with make_unique against the arena.
+void benchmarkVehicleChurn(int rounds, int vehiclesPerRound)
+{
+    using Clock = chrono::steady_clock;
+    const IEngine &engine = sharedEngine<GasEngine>();
+
+    vector<unique_ptr<IVehicle>> heapVehicles;
+    heapVehicles.reserve(vehiclesPerRound);
+    const auto heapStart = Clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int i = 0; i < vehiclesPerRound; ++i)
+            heapVehicles.push_back(make_unique<Car>(engine));
+        heapVehicles.clear();
+    }
+    const chrono::duration<double> heapTime = Clock::now() - heapStart;
+
+    VehicleArena &arena = threadVehicleArena();
+    const auto arenaStart = Clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int i = 0; i < vehiclesPerRound; ++i)
+            arena.create<Car>(engine);
+        arena.reset();
+    }
+    const chrono::duration<double> arenaTime = Clock::now() - arenaStart;
+
+    const double total = static_cast<double>(rounds) * vehiclesPerRound;
+    cout << "make_unique:  " << total / heapTime.count() / 1e6 << "M vehicles/s" << endl;
+    cout << "VehicleArena: " << total / arenaTime.count() / 1e6 << "M vehicles/s" << endl;
+}
+
+// Engine that does nothing, so benchmarks measure only the bridge.
+class IdleEngine : public IEngine
+{
+protected:
+    void startEngine(ostream &) const override {}
 };
 
-int main()
+// Measures SwappableEngine reader throughput, compared with a plain engine,
+// and swap latency while reader threads keep calling start().
+void benchmarkEngineSwap(int readerThreads, int swaps)
 {
-    auto gasEngine = GasEngine();
-    auto electricEngine = ElectricEngine();
-    auto hybridEngine = HybridEngine();
+    using Clock = chrono::steady_clock;
+    constexpr long long readsPerCheck = 1000;
+
+    const auto measureReads = [&](const IEngine &engine, auto &&duringReads) {
+        atomic<bool> stop{false};
+        atomic<long long> reads{0};
+        vector<thread> readers;
+        for (int t = 0; t < readerThreads; ++t)
+            readers.emplace_back([&] {
+                long long local = 0;
+                while (!stop.load(memory_order_relaxed))
+                {
+                    for (long long i = 0; i < readsPerCheck; ++i)
+                        engine.start();
+                    local += readsPerCheck;
+                }
+                reads += local;
+            });
+        const auto start = Clock::now();
+        duringReads();
+        const chrono::duration<double> elapsed = Clock::now() - start;
+        stop = true;
+        for (auto &reader : readers)
+            reader.join();
+        return reads / elapsed.count();
+    };
+
+    const IdleEngine plain;
+    const double plainRate = measureReads(plain, [] { this_thread::sleep_for(chrono::milliseconds(200)); });
+
+    SwappableEngine swappable(make_unique<IdleEngine>());
+    chrono::duration<double, micro> totalSwap{0};
+    const double swappableRate = measureReads(swappable, [&] {
+        for (int i = 0; i < swaps; ++i)
+        {
+            const auto start = Clock::now();
+            swappable.swap(make_unique<IdleEngine>());
+            totalSwap += Clock::now() - start;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    });
+
+    cout << "Plain engine:       " << plainRate / 1e6 << "M start() calls/s" << endl;
+    cout << "SwappableEngine:    " << swappableRate / 1e6 << "M start() calls/s" << endl;
+    cout << "Average swap time:  " << totalSwap.count() / swaps << " us with " << readerThreads << " readers" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Run with --bench to compare allocation churn.
+    if (argc > 1 && string_view(argv[1]) == "--bench")
+    {
+        benchmarkVehicleChurn(10'000, 1'000);
+        return 0;
+    }
+    // Run with --bench-swap to measure engine hot-swapping.
+    if (argc > 1 && string_view(argv[1]) == "--bench-swap")
+    {
+        benchmarkEngineSwap(max(1u, thread::hardware_concurrency()), 200);
+        return 0;
+    }
+
+    const auto &gasEngine = sharedEngine<GasEngine>();
+    const auto &electricEngine = sharedEngine<ElectricEngine>();
+    const auto &hybridEngine = sharedEngine<HybridEngine>();
 
     // Create an array of pointers to Vehicle objects.
     const std::unique_ptr<IVehicle> vehicles[] {
@@ -116,5 +610,37 @@ int main()
         cout << endl;
     }
 
+    // The same fleet from the per-thread arena, released in one go.
+    VehicleArena &arena = threadVehicleArena();
+    const IVehicle *pooledVehicles[] {
+        arena.create<Car>(gasEngine),
+        arena.create<Truck>(electricEngine),
+        arena.create<Bike>(hybridEngine)};
+
+    for (const IVehicle *vehicle : pooledVehicles)
+    {
+        vehicle->drive();
+        cout << endl;
+    }
+    arena.reset();
+
+    // The fleet again, driven in buckets.
+    FleetBatch batch;
+    for (const auto &vehicle : vehicles)
+        batch.add(*vehicle);
+    batch.driveAll(cout);
+
+    // Roll out a new hybrid calibration under a vehicle that is already built.
+    SwappableEngine liveHybrid(make_unique<HybridEngine>());
+    const Bike bike(liveHybrid);
+    bike.drive();
+    liveHybrid.swap(make_unique<TunedHybridEngine>());
+    bike.drive();
+
+    // A batch drives it through the swapped engine as well.
+    FleetBatch liveBatch;
+    liveBatch.add(bike);
+    liveBatch.driveAll(cout);
+
     return 0;
 }
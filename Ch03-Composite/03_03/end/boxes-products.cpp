@@ -1,37 +1,121 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <string_view>
+#include <cstring>
+#include <iomanip>
+#include <span>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <limits>
+#include <iterator>
+#include <fstream>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
+class Box;
+class ProductTree;
+
+enum class ProductKind : uint8_t { Book, Toy, Box };
+
 // Abstract base class for Box and concrete product types
 class Product
 {
 public:
+    Product() = default;
+    // A product is linked to its box and its children by address, so it
+    // can be neither copied nor moved.
+    Product(const Product &) = delete;
+    Product &operator=(const Product &) = delete;
     virtual double price() const = 0;
-    virtual ~Product() = default;
+    virtual ~Product();
+
+    // Price without console output or caching, safe to call from any thread.
+    virtual double listPrice() const = 0;
+
+    // Number of products in this subtree, counting this one.
+    virtual size_t subtreeSize() const { return 1; }
+
+    virtual const Box *asBox() const { return nullptr; }
+    virtual ProductKind kind() const = 0;
+    virtual string_view name() const = 0;
+
+    // The box this product is in, if any. A product is in at most one box.
+    Box *parent() const { return m_Parent; }
+
+    // Changes whenever this product or anything below it changes.
+    uint64_t version() const { return m_Version; }
+
+protected:
+    // Tells the enclosing boxes that their cached totals are stale.
+    void priceChanged();
+
+    // Gives this product and its ancestors a new version.
+    void stampVersion();
+
+private:
+    friend class Box;
+    friend class ProductTree;
+
+    static uint64_t nextVersion()
+    {
+        static atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    Box *m_Parent = nullptr;
+    const ProductTree *m_Tree = nullptr; // Arena that owns this product, if any
+    uint64_t m_Version = nextVersion();
 };
 
 // Concrete product classes
 class Book : public Product
 {
 public:
-    Book(const string &title, double price) : m_Title(title), m_Price(price) {}
+    Book(string_view title, double price, pmr::memory_resource *resource = pmr::get_default_resource())
+        : m_Title(title, resource), m_Price(price) {}
     double price() const override
     {
         cout << "Getting \"" << m_Title << "\" book price" << endl;
         return m_Price;
     }
 
+    double listPrice() const override { return m_Price; }
+    ProductKind kind() const override { return ProductKind::Book; }
+    string_view name() const override { return m_Title; }
+
+    void setPrice(double price)
+    {
+        m_Price = price;
+        priceChanged();
+    }
+
 private:
-    std::string m_Title;
+    pmr::string m_Title;
     double m_Price;
 };
 
 class Toy : public Product
 {
 public:
-    Toy(const string &name, double price) : m_Name(name), m_PriceTag(price) {}
+    Toy(string_view name, double price, pmr::memory_resource *resource = pmr::get_default_resource())
+        : m_Name(name, resource), m_PriceTag(price) {}
     
     double price() const override
     {
@@ -39,24 +123,74 @@ public:
         return m_PriceTag;
     }
 
+    double listPrice() const override { return m_PriceTag; }
+    ProductKind kind() const override { return ProductKind::Toy; }
+    string_view name() const override { return m_Name; }
+
+    void setPrice(double price)
+    {
+        m_PriceTag = price;
+        priceChanged();
+    }
+
 private:
-    std::string m_Name;
+    pmr::string m_Name;
     double m_PriceTag;
 };
 
-// Box class that holds products and other boxes
+// Box class that holds products and other boxes. The total is cached and only
+// recomputed after a change below this box, so repeated price() calls are O(1)
+// and a change costs O(depth) to propagate.
 class Box : public Product
 {
 public:
-    explicit Box(const string &name) : m_Name(name) {}
+    explicit Box(string_view name, pmr::memory_resource *resource = pmr::get_default_resource())
+        : m_Name(name, resource), m_Products(resource) {}
+
+    ~Box() override
+    {
+        // Leave the parent here rather than in ~Product: only while this is
+        // still a Box does subtreeSize() report the whole subtree.
+        if (parent())
+            parent()->removeProduct(*this);
+        for (Product *product : m_Products)
+            product->m_Parent = nullptr;
+    }
 
     void addProduct(Product &product)
     {
+        if (product.m_Parent)
+            throw logic_error("Product is already in a box");
+        if (product.m_Tree != m_Tree)
+            throw logic_error("Box and product belong to different ProductTrees");
+        for (const Box *box = this; box; box = box->parent())
+            if (box == &product)
+                throw logic_error("A box cannot contain itself");
+
+        product.m_Parent = this;
         m_Products.push_back(&product);
+        adjustSize(static_cast<ptrdiff_t>(product.subtreeSize()));
+        stampVersion();
+        invalidate();
+    }
+
+    void removeProduct(Product &product)
+    {
+        const auto it = find(m_Products.begin(), m_Products.end(), &product);
+        if (it == m_Products.end())
+            return;
+        m_Products.erase(it);
+        product.m_Parent = nullptr;
+        adjustSize(-static_cast<ptrdiff_t>(product.subtreeSize()));
+        stampVersion();
+        invalidate();
     }
 
     double price() const override
     {
+        if (!m_Dirty)
+            return m_CachedPrice;
+
         cout << "Opening " << m_Name << endl;
         double totalPrice = 0;
 
@@ -65,16 +199,1270 @@ public:
             totalPrice += product->price();
         }
 
+        m_CachedPrice = totalPrice;
+        m_Dirty = false;
+        return totalPrice;
+    }
+
+    double listPrice() const override
+    {
+        double totalPrice = 0;
+        for (const auto &product : m_Products)
+            totalPrice += product->listPrice();
         return totalPrice;
     }
 
+    size_t subtreeSize() const override { return m_Size; }
+    const Box *asBox() const override { return this; }
+    ProductKind kind() const override { return ProductKind::Box; }
+    string_view name() const override { return m_Name; }
+    const pmr::vector<Product*> &products() const { return m_Products; }
+
+    // Marks this box and its ancestors stale; stops at the first box that
+    // already is, since everything above it is stale too.
+    void invalidate()
+    {
+        for (Box *box = this; box && !box->m_Dirty; box = box->parent())
+            box->m_Dirty = true;
+    }
+
+private:
+    void adjustSize(ptrdiff_t delta)
+    {
+        for (Box *box = this; box; box = box->parent())
+            box->m_Size += delta;
+    }
+
+    pmr::string m_Name;
+    pmr::vector<Product*> m_Products;
+    size_t m_Size = 1;
+    mutable double m_CachedPrice = 0;
+    mutable bool m_Dirty = true;
+};
+
+inline Product::~Product()
+{
+    if (m_Parent)
+        m_Parent->removeProduct(*this);
+}
+
+inline void Product::priceChanged()
+{
+    stampVersion();
+    if (m_Parent)
+        m_Parent->invalidate();
+}
+
+inline void Product::stampVersion()
+{
+    const uint64_t version = nextVersion();
+    for (Product *product = this; product; product = product->m_Parent)
+        product->m_Version = version;
+}
+
+// Owns every product of one catalog snapshot. Nodes, their names and the
+// boxes' child lists all live in a single monotonic arena, so building a tree
+// is mostly pointer bumps and destroying it frees everything at once without
+// visiting the nodes. The returned references stay valid for the lifetime of
+// the tree. Its boxes only accept products created by the same tree, and its
+// products cannot go into any other box, so nothing outside the arena can
+// hold a link into it.
+class ProductTree
+{
+public:
+    explicit ProductTree(string_view rootName, size_t initialBytes = 64 * 1024)
+        : m_Arena(initialBytes), m_Root(create<Box>(rootName)) {}
+
+    ProductTree(const ProductTree &) = delete;
+    ProductTree &operator=(const ProductTree &) = delete;
+
+    // Node destructors are skipped on purpose: all the memory they would free
+    // belongs to the arena, and the whole tree goes away together.
+    ~ProductTree() = default;
+
+    Box &root() { return m_Root; }
+    size_t size() const { return m_Root.subtreeSize(); }
+
+    Box &addBox(Box &parent, string_view name) { return add(parent, create<Box>(name)); }
+    Book &addBook(Box &parent, string_view title, double price) { return add(parent, create<Book>(title, price)); }
+    Toy &addToy(Box &parent, string_view name, double price) { return add(parent, create<Toy>(name, price)); }
+
+private:
+    template <typename T, typename... Args>
+    T &create(Args &&...args)
+    {
+        void *storage = m_Arena.allocate(sizeof(T), alignof(T));
+        T &product = *new (storage) T(std::forward<Args>(args)..., &m_Arena);
+        product.m_Tree = this;
+        return product;
+    }
+
+    template <typename T>
+    T &add(Box &parent, T &product)
+    {
+        parent.addProduct(product);
+        return product;
+    }
+
+    pmr::monotonic_buffer_resource m_Arena;
+    Box &m_Root;
+};
+
+// Flattened, read-only copy of a product tree: one entry per product in
+// preorder, stored as columns (node, kind, price, subtree size). A box's
+// subtree is the entries [i, i + subtreeSize[i]), so pricing and queries are
+// linear scans over contiguous arrays instead of pointer chasing. refresh()
+// brings the columns up to date after the tree changed, revisiting only
+// subtrees whose version moved and rebuilding only boxes whose contents did.
+class FlatCatalog
+{
+public:
+    explicit FlatCatalog(const Product &root) : m_Root(root)
+    {
+        append(m_Columns, root);
+    }
+
+    void refresh()
+    {
+        refreshAt(0, m_Root);
+    }
+
+    size_t size() const { return m_Columns.nodes.size(); }
+
+    double price() const { return price(0); }
+
+    // Total of the subtree at `index`: the plain products in its range.
+    double price(size_t index) const
+    {
+        double total = 0;
+        const size_t end = index + m_Columns.subtreeSizes[index];
+        for (size_t i = index; i < end; ++i)
+            total += m_Columns.prices[i];
+        return total;
+    }
+
+    span<const Product *const> nodes() const { return m_Columns.nodes; }
+    span<const ProductKind> kinds() const { return m_Columns.kinds; }
+    span<const double> prices() const { return m_Columns.prices; }           // 0 for boxes
+    span<const uint32_t> subtreeSizes() const { return m_Columns.subtreeSizes; }
+
+private:
+    struct Columns
+    {
+        vector<const Product *> nodes;
+        vector<ProductKind> kinds;
+        vector<double> prices;
+        vector<uint32_t> subtreeSizes;
+        vector<uint64_t> versions;
+    };
+
+    static void append(Columns &columns, const Product &product)
+    {
+        const size_t index = columns.nodes.size();
+        columns.nodes.push_back(&product);
+        columns.kinds.push_back(product.kind());
+        columns.prices.push_back(product.asBox() ? 0.0 : product.listPrice());
+        columns.subtreeSizes.push_back(1);
+        columns.versions.push_back(product.version());
+        if (const Box *box = product.asBox())
+        {
+            for (const Product *child : box->products())
+                append(columns, *child);
+            columns.subtreeSizes[index] = static_cast<uint32_t>(columns.nodes.size() - index);
+        }
+    }
+
+    // Brings the entry at `index` for `product` up to date and returns the
+    // size of its (possibly new) subtree.
+    size_t refreshAt(size_t index, const Product &product)
+    {
+        if (m_Columns.versions[index] == product.version())
+            return m_Columns.subtreeSizes[index];
+
+        // A product freed and replaced by another at the same address can be
+        // of a different kind, so only refresh in place if the kind matches.
+        const Box *box = product.asBox();
+        if (m_Columns.kinds[index] == product.kind())
+        {
+            if (!box)
+            {
+                m_Columns.prices[index] = product.listPrice();
+                m_Columns.versions[index] = product.version();
+                return 1;
+            }
+
+            // Same children in the same places: refresh them in place.
+            if (sameChildren(index, *box))
+            {
+                size_t position = index + 1;
+                for (const Product *child : box->products())
+                    position += refreshAt(position, *child);
+                m_Columns.subtreeSizes[index] = static_cast<uint32_t>(position - index);
+                m_Columns.versions[index] = product.version();
+                return position - index;
+            }
+        }
+
+        // Kind or contents changed: rebuild this range and splice it in.
+        const size_t oldEnd = index + m_Columns.subtreeSizes[index];
+        Columns rebuilt;
+        append(rebuilt, product);
+        splice(m_Columns.nodes, index, oldEnd, rebuilt.nodes);
+        splice(m_Columns.kinds, index, oldEnd, rebuilt.kinds);
+        splice(m_Columns.prices, index, oldEnd, rebuilt.prices);
+        splice(m_Columns.subtreeSizes, index, oldEnd, rebuilt.subtreeSizes);
+        splice(m_Columns.versions, index, oldEnd, rebuilt.versions);
+        return rebuilt.nodes.size();
+    }
+
+    // Whether the entries below `index` start with the box's children, in
+    // order, and end where its old range ends.
+    bool sameChildren(size_t index, const Box &box) const
+    {
+        const size_t oldEnd = index + m_Columns.subtreeSizes[index];
+        size_t position = index + 1;
+        for (const Product *child : box.products())
+        {
+            if (position >= oldEnd || m_Columns.nodes[position] != child)
+                return false;
+            position += m_Columns.subtreeSizes[position];
+        }
+        return position == oldEnd;
+    }
+
+    template <typename T>
+    static void splice(vector<T> &column, size_t begin, size_t end, const vector<T> &replacement)
+    {
+        column.erase(column.begin() + begin, column.begin() + end);
+        column.insert(column.begin() + begin, replacement.begin(), replacement.end());
+    }
+
+    const Product &m_Root;
+    Columns m_Columns;
+};
+
+// On-disk catalog snapshot. The file is a header, one fixed-size record per
+// product in preorder, and a string table holding the names. Every field is
+// stored in native byte order at its natural alignment, so a mapped file is
+// used as-is with no parsing pass.
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t byteOrderMark;
+    uint32_t nodeCount;
+    uint64_t stringTableOffset;
+    uint64_t stringTableSize;
+};
+
+struct SnapshotNode
+{
+    ProductKind kind;
+    uint8_t reserved[3];
+    uint32_t subtreeSize;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    double price; // 0 for boxes
+};
+
+constexpr char snapshotMagic[8] = {'B', 'O', 'X', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t snapshotByteOrderMark = 0x01020304;
+
+// Snapshot counts and string offsets are 32 bits wide.
+inline uint32_t snapshotField(size_t value, const char *what)
+{
+    if (value > numeric_limits<uint32_t>::max())
+        throw runtime_error(string("Catalog is too large for a snapshot: ") + what + " exceeds 32 bits");
+    return static_cast<uint32_t>(value);
+}
+
+// Writes the tree under `root` as a snapshot file.
+void writeSnapshot(const Product &root, const filesystem::path &path)
+{
+    vector<SnapshotNode> nodes;
+    string strings;
+    const function<void(const Product &)> append = [&](const Product &product) {
+        const size_t index = nodes.size();
+        const string_view name = product.name();
+        SnapshotNode node{};
+        node.kind = product.kind();
+        node.subtreeSize = 1;
+        node.nameOffset = snapshotField(strings.size(), "name offset");
+        node.nameLength = snapshotField(name.size(), "name length");
+        node.price = product.asBox() ? 0.0 : product.listPrice();
+        nodes.push_back(node);
+        strings.append(name);
+        if (const Box *box = product.asBox())
+        {
+            for (const Product *child : box->products())
+                append(*child);
+            nodes[index].subtreeSize = snapshotField(nodes.size() - index, "subtree size");
+        }
+    };
+    append(root);
+
+    SnapshotHeader header{};
+    copy(begin(snapshotMagic), end(snapshotMagic), header.magic);
+    header.byteOrderMark = snapshotByteOrderMark;
+    header.nodeCount = snapshotField(nodes.size(), "node count");
+    header.stringTableOffset = sizeof(SnapshotHeader) + nodes.size() * sizeof(SnapshotNode);
+    header.stringTableSize = strings.size();
+
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(nodes.data()), static_cast<streamsize>(nodes.size() * sizeof(SnapshotNode)));
+    out.write(strings.data(), static_cast<streamsize>(strings.size()));
+    if (!out)
+        throw runtime_error("Could not write snapshot " + path.string());
+}
+
+// Read-only view of a snapshot file mapped into memory. Opening checks the
+// header and the sizes once; after that prices and names are read straight
+// from the mapping.
+class CatalogSnapshot
+{
+public:
+    explicit CatalogSnapshot(const filesystem::path &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Could not open snapshot " + path.string());
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+        {
+            ::close(fd);
+            throw runtime_error("Snapshot is too small: " + path.string());
+        }
+        m_Size = static_cast<size_t>(info.st_size);
+        m_Data = ::mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m_Data == MAP_FAILED)
+            throw runtime_error("Could not map snapshot " + path.string());
+
+        try
+        {
+            validate();
+        }
+        catch (...)
+        {
+            ::munmap(m_Data, m_Size);
+            throw;
+        }
+    }
+
+    CatalogSnapshot(const CatalogSnapshot &) = delete;
+    CatalogSnapshot &operator=(const CatalogSnapshot &) = delete;
+
+    ~CatalogSnapshot()
+    {
+        ::munmap(m_Data, m_Size);
+    }
+
+    size_t size() const { return header().nodeCount; }
+
+    const SnapshotNode &node(size_t index) const { return nodes()[index]; }
+
+    string_view name(size_t index) const
+    {
+        const SnapshotNode &entry = node(index);
+        return string_view(bytes() + header().stringTableOffset + entry.nameOffset, entry.nameLength);
+    }
+
+    double price() const { return price(0); }
+
+    // Total of the subtree at `index`, in the same order as FlatCatalog::price().
+    double price(size_t index) const
+    {
+        const span<const SnapshotNode> all = nodes();
+        double total = 0;
+        const size_t end = index + all[index].subtreeSize;
+        for (size_t i = index; i < end; ++i)
+            total += all[i].price;
+        return total;
+    }
+
+private:
+    const char *bytes() const { return static_cast<const char *>(m_Data); }
+    const SnapshotHeader &header() const { return *reinterpret_cast<const SnapshotHeader *>(m_Data); }
+
+    span<const SnapshotNode> nodes() const
+    {
+        return {reinterpret_cast<const SnapshotNode *>(bytes() + sizeof(SnapshotHeader)), header().nodeCount};
+    }
+
+    void validate() const
+    {
+        const SnapshotHeader &h = header();
+        if (!equal(begin(snapshotMagic), end(snapshotMagic), h.magic))
+            throw runtime_error("Not a catalog snapshot");
+        if (h.byteOrderMark != snapshotByteOrderMark)
+            throw runtime_error("Snapshot was written with a different byte order");
+        const uint64_t nodesEnd = sizeof(SnapshotHeader) + uint64_t{h.nodeCount} * sizeof(SnapshotNode);
+        if (h.nodeCount == 0 || h.stringTableOffset != nodesEnd || nodesEnd + h.stringTableSize != m_Size)
+            throw runtime_error("Snapshot is truncated or corrupt");
+        for (size_t i = 0; i < h.nodeCount; ++i)
+        {
+            const SnapshotNode &entry = nodes()[i];
+            if (entry.subtreeSize == 0 || i + entry.subtreeSize > h.nodeCount ||
+                uint64_t{entry.nameOffset} + entry.nameLength > h.stringTableSize)
+                throw runtime_error("Snapshot is truncated or corrupt");
+        }
+    }
+
+    void *m_Data = nullptr;
+    size_t m_Size = 0;
+};
+
+// Work-stealing pool for fork-join work. Each thread owns a deque: it pushes
+// and pops its own tasks at the back, while idle threads steal from the front.
+// A thread waiting in invokeAll() keeps running tasks instead of blocking, so
+// nested forks cannot deadlock the pool.
+class ForkJoinPool
+{
+public:
+    explicit ForkJoinPool(size_t threadCount = max(1u, thread::hardware_concurrency()))
+    {
+        // The last queue is shared by threads from outside the pool.
+        for (size_t i = 0; i <= threadCount; ++i)
+            m_queues.push_back(make_unique<WorkQueue>());
+        for (size_t i = 0; i < threadCount; ++i)
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ForkJoinPool(const ForkJoinPool &) = delete;
+    ForkJoinPool &operator=(const ForkJoinPool &) = delete;
+
+    ~ForkJoinPool()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto &worker : m_workers)
+            worker.join();
+    }
+
+    // Runs every task and returns once all have finished.
+    void invokeAll(vector<function<void()>> &tasks)
+    {
+        if (tasks.empty())
+            return;
+
+        auto remaining = make_shared<atomic<size_t>>(tasks.size());
+        const size_t self = currentQueue();
+        for (size_t i = 1; i < tasks.size(); ++i)
+        {
+            WorkQueue &queue = *m_queues[self];
+            lock_guard<mutex> lock(queue.mutex);
+            queue.tasks.push_back([task = move(tasks[i]), remaining] {
+                task();
+                --*remaining;
+            });
+            ++m_queued;
+        }
+        {
+            lock_guard<mutex> lock(m_mutex);
+        }
+        m_wake.notify_all();
+
+        tasks[0]();
+        --*remaining;
+        while (*remaining > 0)
+        {
+            if (!runOne(self))
+                this_thread::yield();
+        }
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        deque<function<void()>> tasks;
+    };
+
+    size_t currentQueue() const
+    {
+        return t_owner == this ? t_index : m_queues.size() - 1;
+    }
+
+    bool runOne(size_t self)
+    {
+        for (size_t k = 0; k < m_queues.size(); ++k)
+        {
+            WorkQueue &queue = *m_queues[(self + k) % m_queues.size()];
+            function<void()> task;
+            {
+                lock_guard<mutex> lock(queue.mutex);
+                if (queue.tasks.empty())
+                    continue;
+                if (k == 0)
+                {
+                    task = move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                --m_queued;
+            }
+            task();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index)
+    {
+        t_owner = this;
+        t_index = index;
+        for (;;)
+        {
+            if (runOne(index))
+                continue;
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0)
+                return;
+        }
+    }
+
+    static thread_local const ForkJoinPool *t_owner;
+    static thread_local size_t t_index;
+
+    vector<unique_ptr<WorkQueue>> m_queues;
+    vector<thread> m_workers;
+    mutex m_mutex;
+    condition_variable m_wake;
+    atomic<size_t> m_queued{0};
+    bool m_stopping = false;
+};
+
+thread_local const ForkJoinPool *ForkJoinPool::t_owner = nullptr;
+thread_local size_t ForkJoinPool::t_index = 0;
+
+// How a box adds up the subtotals of its children.
+enum class Summation
+{
+    Naive,    // Left to right, exactly like Box::price()
+    Kahan,    // Compensated, left to right
+    Pairwise  // Recursive halving
+};
+
+inline double pairwiseSum(const double *values, size_t count)
+{
+    if (count <= 8)
+    {
+        double total = 0;
+        for (size_t i = 0; i < count; ++i)
+            total += values[i];
+        return total;
+    }
+    const size_t half = count / 2;
+    return pairwiseSum(values, half) + pairwiseSum(values + half, count - half);
+}
+
+inline double sumValues(span<const double> values, Summation summation)
+{
+    switch (summation)
+    {
+    case Summation::Kahan:
+    {
+        double total = 0, compensation = 0;
+        for (const double value : values)
+        {
+            const double corrected = value - compensation;
+            const double next = total + corrected;
+            compensation = (next - total) - corrected;
+            total = next;
+        }
+        return total;
+    }
+    case Summation::Pairwise:
+        return pairwiseSum(values.data(), values.size());
+    case Summation::Naive:
+    default:
+    {
+        double total = 0;
+        for (const double value : values)
+            total += value;
+        return total;
+    }
+    }
+}
+
+// Prices a product tree, splitting boxes whose subtree holds at least
+// `threshold` products into tasks on the pool. Every box always combines its
+// children's subtotals in child order with the chosen summation, so the result
+// does not depend on the thread count or on scheduling: with a pool it is
+// bit-for-bit the result without one. Summation::Naive also matches
+// Box::listPrice() and Box::price().
+class TreePricer
+{
+public:
+    TreePricer(Summation summation, size_t threshold = 4096) : m_Summation(summation), m_Threshold(threshold) {}
+
+    double price(const Product &root, ForkJoinPool *pool = nullptr) const
+    {
+        const Box *box = root.asBox();
+        if (!box)
+            return root.listPrice();
+
+        const auto &products = box->products();
+        vector<double> subtotals(products.size());
+        if (pool && box->subtreeSize() >= m_Threshold)
+        {
+            vector<function<void()>> tasks;
+            size_t leaves = 0;
+            for (size_t i = 0; i < products.size(); ++i)
+            {
+                if (products[i]->asBox())
+                    tasks.push_back([&, i] { subtotals[i] = price(*products[i], pool); });
+                else
+                    ++leaves;
+            }
+            // Plain products are priced in batches so tasks stay worth scheduling.
+            const size_t batch = max<size_t>(m_Threshold, 1);
+            for (size_t begin = 0; leaves > 0 && begin < products.size(); begin += batch)
+            {
+                const size_t end = min(products.size(), begin + batch);
+                tasks.push_back([&, begin, end] {
+                    for (size_t i = begin; i < end; ++i)
+                        if (!products[i]->asBox())
+                            subtotals[i] = products[i]->listPrice();
+                });
+            }
+            pool->invokeAll(tasks);
+        }
+        else
+        {
+            for (size_t i = 0; i < products.size(); ++i)
+                subtotals[i] = price(*products[i], pool);
+        }
+        return sumValues(subtotals, m_Summation);
+    }
+
+private:
+    const Summation m_Summation;
+    const size_t m_Threshold;
+};
+
+// One catalog entry as a query sees it. Kind and price come from the
+// catalog's columns; `product` is there for aggregates that report products.
+struct CatalogRow
+{
+    size_t index;
+    ProductKind kind;
+    double price; // 0 for boxes
+    const Product *product;
+};
+
+// Condition a plain product must meet to take part in a query. It only reads
+// the kind and price columns, so rejected products are never dereferenced.
+struct ProductFilter
+{
+    optional<ProductKind> kind;
+    double minPrice = -numeric_limits<double>::infinity(); // Inclusive
+    double maxPrice = numeric_limits<double>::infinity();  // Exclusive
+
+    bool matches(ProductKind productKind, double price) const
+    {
+        return (!kind || *kind == productKind) && price >= minPrice && price < maxPrice;
+    }
+
+    bool operator()(const CatalogRow &row) const { return matches(row.kind, row.price); }
+};
+
+// One aggregate computed by a CatalogQuery. The query calls accept() for every
+// plain product that passed its predicate, in preorder, and openBox() and
+// closeBox() around the contents of every box. For a parallel scan it fork()s
+// an empty aggregator per task and merge()s the forks back in preorder; a fork
+// covers whole child boxes or runs of plain products, so it has no box still
+// open when it is merged.
+class CatalogAggregator
+{
+public:
+    virtual unique_ptr<CatalogAggregator> fork() const = 0;
+    virtual void accept(const CatalogRow &row) = 0;
+    virtual void merge(CatalogAggregator &other) = 0;
+    virtual void openBox(const CatalogRow &) {}
+    virtual void closeBox(const CatalogRow &) {}
+    virtual ~CatalogAggregator() = default;
+};
+
+// Several aggregates computed in the same pass.
+class AggregatorSet : public CatalogAggregator
+{
+public:
+    explicit AggregatorSet(vector<CatalogAggregator *> members) : m_Members(move(members)) {}
+
+    unique_ptr<CatalogAggregator> fork() const override
+    {
+        vector<unique_ptr<CatalogAggregator>> owned;
+        vector<CatalogAggregator *> members;
+        for (const CatalogAggregator *member : m_Members)
+        {
+            owned.push_back(member->fork());
+            members.push_back(owned.back().get());
+        }
+        auto forked = make_unique<AggregatorSet>(move(members));
+        forked->m_Owned = move(owned);
+        return forked;
+    }
+
+    void accept(const CatalogRow &row) override
+    {
+        for (CatalogAggregator *member : m_Members)
+            member->accept(row);
+    }
+
+    void merge(CatalogAggregator &other) override
+    {
+        auto &set = static_cast<AggregatorSet &>(other);
+        for (size_t i = 0; i < m_Members.size(); ++i)
+            m_Members[i]->merge(*set.m_Members[i]);
+    }
+
+    void openBox(const CatalogRow &row) override
+    {
+        for (CatalogAggregator *member : m_Members)
+            member->openBox(row);
+    }
+
+    void closeBox(const CatalogRow &row) override
+    {
+        for (CatalogAggregator *member : m_Members)
+            member->closeBox(row);
+    }
+
+private:
+    vector<CatalogAggregator *> m_Members;
+    vector<unique_ptr<CatalogAggregator>> m_Owned; // Only in forks
+};
+
+class CountAggregator : public CatalogAggregator
+{
+public:
+    unique_ptr<CatalogAggregator> fork() const override { return make_unique<CountAggregator>(); }
+    void accept(const CatalogRow &) override { ++m_Count; }
+    void merge(CatalogAggregator &other) override { m_Count += static_cast<CountAggregator &>(other).m_Count; }
+
+    size_t count() const { return m_Count; }
+
+private:
+    size_t m_Count = 0;
+};
+
+// Total price of the accepted products. Like TreePricer, every box adds up its
+// children's subtotals in child order with the chosen summation, so the total
+// is bit-for-bit the same with or without a pool.
+class SumAggregator : public CatalogAggregator
+{
+public:
+    explicit SumAggregator(Summation summation = Summation::Naive) : m_Summation(summation) {}
+
+    unique_ptr<CatalogAggregator> fork() const override { return make_unique<SumAggregator>(m_Summation); }
+    void accept(const CatalogRow &row) override { m_Levels.back().push_back(row.price); }
+
+    void merge(CatalogAggregator &other) override
+    {
+        const vector<double> &values = static_cast<SumAggregator &>(other).m_Levels.front();
+        m_Levels.back().insert(m_Levels.back().end(), values.begin(), values.end());
+    }
+
+    void openBox(const CatalogRow &) override { m_Levels.emplace_back(); }
+
+    void closeBox(const CatalogRow &) override
+    {
+        const double subtotal = sumValues(m_Levels.back(), m_Summation);
+        m_Levels.pop_back();
+        m_Levels.back().push_back(subtotal);
+    }
+
+    double total() const { return sumValues(m_Levels.front(), m_Summation); }
+
+private:
+    const Summation m_Summation;
+    vector<vector<double>> m_Levels{1}; // Subtotals of the open boxes, outermost first
+};
+
+// Most expensive accepted product; the first in preorder on ties.
+class MostExpensiveAggregator : public CatalogAggregator
+{
+public:
+    unique_ptr<CatalogAggregator> fork() const override { return make_unique<MostExpensiveAggregator>(); }
+
+    void accept(const CatalogRow &row) override
+    {
+        if (!m_Product || row.price > m_Price)
+        {
+            m_Product = row.product;
+            m_Price = row.price;
+        }
+    }
+
+    void merge(CatalogAggregator &other) override
+    {
+        const auto &best = static_cast<MostExpensiveAggregator &>(other);
+        if (best.m_Product && (!m_Product || best.m_Price > m_Price))
+        {
+            m_Product = best.m_Product;
+            m_Price = best.m_Price;
+        }
+    }
+
+    const Product *product() const { return m_Product; }
+
+private:
+    const Product *m_Product = nullptr;
+    double m_Price = 0;
+};
+
+// Every accepted product, in preorder.
+class CollectAggregator : public CatalogAggregator
+{
+public:
+    unique_ptr<CatalogAggregator> fork() const override { return make_unique<CollectAggregator>(); }
+    void accept(const CatalogRow &row) override { m_Products.push_back(row.product); }
+
+    void merge(CatalogAggregator &other) override
+    {
+        const auto &products = static_cast<CollectAggregator &>(other).m_Products;
+        m_Products.insert(m_Products.end(), products.begin(), products.end());
+    }
+
+    const vector<const Product *> &products() const { return m_Products; }
+
+private:
+    vector<const Product *> m_Products;
+};
+
+// The k most expensive accepted products under every box, most expensive
+// first, with boxes in preorder. A box's list is built from its children's,
+// so each product is compared against at most k others per level.
+class TopPerBoxAggregator : public CatalogAggregator
+{
+public:
+    using Entry = pair<const Box *, vector<const Product *>>;
+
+    explicit TopPerBoxAggregator(size_t k) : m_K(k) {}
+
+    unique_ptr<CatalogAggregator> fork() const override { return make_unique<TopPerBoxAggregator>(m_K); }
+    void accept(const CatalogRow &row) override { insert(m_Open.back().top, {row.price, row.product}); }
+
+    void merge(CatalogAggregator &other) override
+    {
+        auto &forked = static_cast<TopPerBoxAggregator &>(other);
+        move(forked.m_Boxes.begin(), forked.m_Boxes.end(), back_inserter(m_Boxes));
+        for (const Candidate &candidate : forked.m_Open.front().top)
+            insert(m_Open.back().top, candidate);
+    }
+
+    // The box takes its place in preorder before anything below it.
+    void openBox(const CatalogRow &row) override
+    {
+        m_Boxes.emplace_back(row.product->asBox(), vector<const Product *>());
+        m_Open.push_back({m_Boxes.size() - 1, {}});
+    }
+
+    void closeBox(const CatalogRow &) override
+    {
+        const Level level = move(m_Open.back());
+        m_Open.pop_back();
+        vector<const Product *> &top = m_Boxes[level.slot].second;
+        for (const Candidate &candidate : level.top)
+        {
+            top.push_back(candidate.second);
+            insert(m_Open.back().top, candidate);
+        }
+    }
+
+    const vector<Entry> &boxes() const { return m_Boxes; }
+
+private:
+    using Candidate = pair<double, const Product *>;
+
+    struct Level
+    {
+        size_t slot;
+        vector<Candidate> top;
+    };
+
+    // Candidates arrive in preorder, so equal prices keep their preorder order.
+    void insert(vector<Candidate> &top, const Candidate &candidate) const
+    {
+        if (top.size() == m_K && (m_K == 0 || candidate.first <= top.back().first))
+            return;
+        const auto position = upper_bound(top.begin(), top.end(), candidate.first,
+                                          [](double price, const Candidate &other) { return price > other.first; });
+        top.insert(position, candidate);
+        if (top.size() > m_K)
+            top.pop_back();
+    }
+
+    const size_t m_K;
+    vector<Entry> m_Boxes;
+    vector<Level> m_Open{Level{0, {}}}; // The bottom level collects what is not in an open box
+};
+
+// Runs aggregators over a flattened product tree in one preorder walk. The
+// predicate is applied once per plain product inside the scan, before any
+// aggregator sees it, so however many aggregates a query computes, a rejected
+// product costs one check. Like TreePricer, boxes holding at least `threshold`
+// products are split into tasks on the pool, each with a fork of the
+// aggregator, and the forks are merged back in child order, so every built-in
+// aggregate is the same with or without a pool.
+class CatalogQuery
+{
+public:
+    using Predicate = function<bool(const CatalogRow &)>;
+
+    explicit CatalogQuery(Predicate predicate = {}, size_t threshold = 4096)
+        : m_Predicate(move(predicate)), m_Threshold(threshold) {}
+
+    // Feeds the subtree at `index` to `aggregator`.
+    void run(const FlatCatalog &catalog, CatalogAggregator &aggregator, size_t index = 0,
+             ForkJoinPool *pool = nullptr) const
+    {
+        const Scan scan{catalog.nodes(), catalog.kinds(), catalog.prices(), catalog.subtreeSizes()};
+        visit(scan, index, aggregator, pool);
+    }
+
 private:
-    string m_Name;
-    std::vector<Product*> m_Products;
+    struct Scan
+    {
+        span<const Product *const> nodes;
+        span<const ProductKind> kinds;
+        span<const double> prices;
+        span<const uint32_t> sizes;
+
+        CatalogRow row(size_t index) const { return {index, kinds[index], prices[index], nodes[index]}; }
+    };
+
+    // A run of entries handled by one task: a whole child box or a batch of
+    // plain products.
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+        bool box;
+    };
+
+    void visit(const Scan &scan, size_t index, CatalogAggregator &aggregator, ForkJoinPool *pool) const
+    {
+        const CatalogRow row = scan.row(index);
+        if (row.kind != ProductKind::Box)
+        {
+            offer(row, aggregator);
+            return;
+        }
+
+        aggregator.openBox(row);
+        const size_t end = index + scan.sizes[index];
+        if (!pool || scan.sizes[index] < m_Threshold)
+        {
+            for (size_t child = index + 1; child < end; child += scan.sizes[child])
+            {
+                if (scan.kinds[child] == ProductKind::Box)
+                    visit(scan, child, aggregator, pool);
+                else
+                    offer(scan.row(child), aggregator);
+            }
+        }
+        else
+        {
+            vector<Range> ranges;
+            for (size_t child = index + 1; child < end; child += scan.sizes[child])
+            {
+                if (scan.kinds[child] == ProductKind::Box)
+                    ranges.push_back({child, child + scan.sizes[child], true});
+                else if (!ranges.empty() && !ranges.back().box && ranges.back().end == child &&
+                         ranges.back().end - ranges.back().begin < m_Threshold)
+                    ranges.back().end = child + 1;
+                else
+                    ranges.push_back({child, child + 1, false});
+            }
+
+            vector<unique_ptr<CatalogAggregator>> forks;
+            vector<function<void()>> tasks;
+            for (size_t i = 0; i < ranges.size(); ++i)
+            {
+                forks.push_back(aggregator.fork());
+                tasks.push_back([&, i] {
+                    if (ranges[i].box)
+                        visit(scan, ranges[i].begin, *forks[i], pool);
+                    else
+                        for (size_t j = ranges[i].begin; j < ranges[i].end; ++j)
+                            offer(scan.row(j), *forks[i]);
+                });
+            }
+            pool->invokeAll(tasks);
+            for (const auto &forked : forks)
+                aggregator.merge(*forked);
+        }
+        aggregator.closeBox(row);
+    }
+
+    void offer(const CatalogRow &row, CatalogAggregator &aggregator) const
+    {
+        if (!m_Predicate || m_Predicate(row))
+            aggregator.accept(row);
+    }
+
+    const Predicate m_Predicate;
+    const size_t m_Threshold;
 };
 
-int main()
+// Builds a wide catalog and compares serial and parallel pricing.
+void benchmarkTreePricing(size_t boxCount, size_t toysPerBox)
+{
+    using Clock = chrono::steady_clock;
+
+    vector<unique_ptr<Toy>> toys;
+    vector<unique_ptr<Box>> boxes;
+    Box catalog("Catalog");
+    for (size_t b = 0; b < boxCount; ++b)
+    {
+        boxes.push_back(make_unique<Box>("Box " + to_string(b)));
+        for (size_t t = 0; t < toysPerBox; ++t)
+        {
+            toys.push_back(make_unique<Toy>("Toy", 0.01 * static_cast<double>((b * 7919 + t * 104729) % 10000)));
+            boxes.back()->addProduct(*toys.back());
+        }
+        catalog.addProduct(*boxes.back());
+    }
+
+    ForkJoinPool pool;
+    for (const Summation summation : {Summation::Naive, Summation::Kahan, Summation::Pairwise})
+    {
+        const TreePricer pricer(summation);
+        const auto serialStart = Clock::now();
+        const double serial = pricer.price(catalog);
+        const chrono::duration<double, milli> serialTime = Clock::now() - serialStart;
+        const auto parallelStart = Clock::now();
+        const double parallel = pricer.price(catalog, &pool);
+        const chrono::duration<double, milli> parallelTime = Clock::now() - parallelStart;
+
+        cout << setprecision(17) << "serial " << serial << setprecision(4) << " in " << serialTime.count()
+             << " ms, parallel " << setprecision(17) << parallel << setprecision(4) << " in " << parallelTime.count()
+             << " ms, identical: " << boolalpha << (memcmp(&serial, &parallel, sizeof(double)) == 0) << endl;
+    }
+
+}
+
+// The hand-written recursive walks CatalogQuery replaces, one per question.
+size_t naiveCount(const Product &product, const ProductFilter &filter)
+{
+    if (const Box *box = product.asBox())
+    {
+        size_t count = 0;
+        for (const Product *child : box->products())
+            count += naiveCount(*child, filter);
+        return count;
+    }
+    return filter.matches(product.kind(), product.listPrice()) ? 1 : 0;
+}
+
+const Product *naiveMostExpensive(const Product &product, const ProductFilter &filter)
+{
+    if (const Box *box = product.asBox())
+    {
+        const Product *best = nullptr;
+        for (const Product *child : box->products())
+        {
+            const Product *candidate = naiveMostExpensive(*child, filter);
+            if (candidate && (!best || candidate->listPrice() > best->listPrice()))
+                best = candidate;
+        }
+        return best;
+    }
+    return filter.matches(product.kind(), product.listPrice()) ? &product : nullptr;
+}
+
+void naiveItems(const Product &product, const ProductFilter &filter, vector<const Product *> &items)
+{
+    if (const Box *box = product.asBox())
+    {
+        for (const Product *child : box->products())
+            naiveItems(*child, filter, items);
+    }
+    else if (filter.matches(product.kind(), product.listPrice()))
+    {
+        items.push_back(&product);
+    }
+}
+
+vector<const Product *> naiveTopPerBox(const Product &product, const ProductFilter &filter, size_t k,
+                                       vector<pair<const Box *, vector<const Product *>>> &tops)
+{
+    const Box *box = product.asBox();
+    if (!box)
+    {
+        if (filter.matches(product.kind(), product.listPrice()))
+            return {&product};
+        return {};
+    }
+    const size_t slot = tops.size();
+    tops.emplace_back(box, vector<const Product *>());
+    vector<const Product *> candidates;
+    for (const Product *child : box->products())
+    {
+        const vector<const Product *> childTop = naiveTopPerBox(*child, filter, k, tops);
+        candidates.insert(candidates.end(), childTop.begin(), childTop.end());
+    }
+    stable_sort(candidates.begin(), candidates.end(),
+                [](const Product *a, const Product *b) { return a->listPrice() > b->listPrice(); });
+    if (candidates.size() > k)
+        candidates.resize(k);
+    tops[slot].second = candidates;
+    return candidates;
+}
+
+// Adds up matching products box by box, like SumAggregator with Summation::Naive.
+double naiveTotal(const Product &product, const ProductFilter &filter)
 {
+    if (const Box *box = product.asBox())
+    {
+        double total = 0;
+        for (const Product *child : box->products())
+            if (child->asBox() || filter.matches(child->kind(), child->listPrice()))
+                total += naiveTotal(*child, filter);
+        return total;
+    }
+    return product.listPrice();
+}
+
+// Compares five recursive walks with one CatalogQuery, serial and parallel.
+void benchmarkQueries(size_t boxCount, size_t toysPerBox)
+{
+    using Clock = chrono::steady_clock;
+    using Ms = chrono::duration<double, milli>;
+
+    ProductTree tree("Catalog");
+    for (size_t b = 0; b < boxCount; ++b)
+    {
+        Box &box = tree.addBox(tree.root(), "Box");
+        for (size_t t = 0; t < toysPerBox; ++t)
+        {
+            const double price = 0.01 * static_cast<double>((b * 7919 + t * 104729) % 10000);
+            if (t % 4 == 0)
+                tree.addBook(box, "Book", price);
+            else
+                tree.addToy(box, "Toy", price);
+        }
+    }
+
+    ProductFilter filter;
+    filter.kind = ProductKind::Toy;
+    filter.maxPrice = 50.0;
+    const size_t k = 3;
+
+    auto start = Clock::now();
+    const size_t count = naiveCount(tree.root(), filter);
+    const double total = naiveTotal(tree.root(), filter);
+    const Product *mostExpensive = naiveMostExpensive(tree.root(), filter);
+    vector<const Product *> items;
+    naiveItems(tree.root(), filter, items);
+    vector<pair<const Box *, vector<const Product *>>> tops;
+    naiveTopPerBox(tree.root(), filter, k, tops);
+    cout << "recursive walks:  " << Ms(Clock::now() - start).count() << " ms" << endl;
+
+    start = Clock::now();
+    const FlatCatalog catalog(tree.root());
+    cout << "flattening:       " << Ms(Clock::now() - start).count() << " ms" << endl;
+
+    ForkJoinPool pool;
+    const CatalogQuery query(filter);
+    for (ForkJoinPool *runOn : {static_cast<ForkJoinPool *>(nullptr), &pool})
+    {
+        CountAggregator counted;
+        SumAggregator summed;
+        MostExpensiveAggregator best;
+        CollectAggregator collected;
+        TopPerBoxAggregator topPerBox(k);
+        AggregatorSet all({&counted, &summed, &best, &collected, &topPerBox});
+
+        start = Clock::now();
+        query.run(catalog, all, 0, runOn);
+        const Ms queryTime = Clock::now() - start;
+        const double queryTotal = summed.total();
+        const bool same = counted.count() == count && memcmp(&queryTotal, &total, sizeof(double)) == 0 &&
+                          best.product() == mostExpensive && collected.products() == items && topPerBox.boxes() == tops;
+        cout << (runOn ? "parallel query:   " : "serial query:     ") << queryTime.count()
+             << " ms, same answers: " << boolalpha << same << endl;
+    }
+}
+
+// Compares loading and tearing down a catalog with new/delete and with ProductTree.
+void benchmarkCatalogArena(size_t boxCount, size_t toysPerBox)
+{
+    using Clock = chrono::steady_clock;
+    using Ms = chrono::duration<double, milli>;
+
+    auto start = Clock::now();
+    {
+        vector<unique_ptr<Box>> boxes;
+        vector<unique_ptr<Toy>> toys;
+        auto catalog = make_unique<Box>("Catalog");
+        for (size_t b = 0; b < boxCount; ++b)
+        {
+            boxes.push_back(make_unique<Box>("Box"));
+            for (size_t t = 0; t < toysPerBox; ++t)
+            {
+                toys.push_back(make_unique<Toy>("Toy", 1.0));
+                boxes.back()->addProduct(*toys.back());
+            }
+            catalog->addProduct(*boxes.back());
+        }
+        const Ms loadTime = Clock::now() - start;
+        start = Clock::now();
+        catalog.reset();
+        boxes.clear();
+        toys.clear();
+        cout << "new/delete:  load " << loadTime.count() << " ms, teardown " << Ms(Clock::now() - start).count()
+             << " ms" << endl;
+    }
+
+    start = Clock::now();
+    {
+        auto tree = make_unique<ProductTree>("Catalog");
+        for (size_t b = 0; b < boxCount; ++b)
+        {
+            Box &box = tree->addBox(tree->root(), "Box");
+            for (size_t t = 0; t < toysPerBox; ++t)
+                tree->addToy(box, "Toy", 1.0);
+        }
+        const Ms loadTime = Clock::now() - start;
+        start = Clock::now();
+        tree.reset();
+        cout << "ProductTree: load " << loadTime.count() << " ms, teardown " << Ms(Clock::now() - start).count()
+             << " ms" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Run with --bench to compare serial and parallel pricing on a large tree
+    if (argc > 1 && string_view(argv[1]) == "--bench")
+    {
+        benchmarkTreePricing(1000, 1000);
+        return 0;
+    }
+    // Run with --bench-arena to compare catalog load and teardown
+    if (argc > 1 && string_view(argv[1]) == "--bench-arena")
+    {
+        benchmarkCatalogArena(1000, 1000);
+        return 0;
+    }
+    // Run with --bench-query to compare CatalogQuery with recursive walks
+    if (argc > 1 && string_view(argv[1]) == "--bench-query")
+    {
+        benchmarkQueries(1000, 1000);
+        return 0;
+    }
+
     // Create some products
     Book book1{"Robinson Crusoe", 4.99};
     Toy toy1{"Star Trooper", 39.99};
@@ -95,5 +1483,64 @@ int main()
     cout << "Calculating total price. " << endl
          << bigBox.price() << endl;
 
+    // Nothing changed, so this comes straight from the cache
+    cout << "Calculating total price again. " << endl
+         << bigBox.price() << endl;
+
+    // A price change only reopens the boxes on the path to the root
+    book1.setPrice(7.99);
+    cout << "Calculating total price after a price change. " << endl
+         << bigBox.price() << endl;
+
+    // Same total from the fork-join pricer, computed on a thread pool
+    ForkJoinPool pool;
+    cout << "Parallel total price: " << TreePricer(Summation::Naive, 1).price(bigBox, &pool) << endl;
+
+    // Flatten the tree, then keep the flat copy current as the tree changes
+    FlatCatalog flat(bigBox);
+    cout << "Flattened " << flat.size() << " products, total price: " << flat.price() << endl;
+    Toy toy3{"Rubik's Cube", 9.99};
+    smallBox.addProduct(toy3);
+    toy2.setPrice(49.99);
+    flat.refresh();
+    cout << "After refresh, " << flat.size() << " products, total price: " << flat.price() << endl;
+
+    // Ask several questions about the catalog in one pass
+    ProductFilter underFifty;
+    underFifty.maxPrice = 50.0;
+    CountAggregator counted;
+    MostExpensiveAggregator best;
+    CollectAggregator collected;
+    TopPerBoxAggregator topTwo(2);
+    AggregatorSet questions({&counted, &best, &collected, &topTwo});
+    CatalogQuery(underFifty).run(flat, questions);
+    cout << counted.count() << " products under 50, most expensive: " << best.product()->name() << endl;
+    for (const Product *item : collected.products())
+        cout << "  " << item->name() << endl;
+    for (const auto &[box, top] : topTwo.boxes())
+    {
+        cout << "Top of " << box->name() << ":";
+        for (const Product *item : top)
+            cout << " " << item->name();
+        cout << endl;
+    }
+
+    // A catalog snapshot whose nodes all live in one arena
+    ProductTree tree("Warehouse");
+    Box &shelf = tree.addBox(tree.root(), "Shelf");
+    tree.addBook(shelf, "Moby Dick", 12.49);
+    tree.addToy(shelf, "Yo-yo", 2.99);
+    cout << "Arena catalog of " << tree.size() << " products, total price: " << tree.root().listPrice() << endl;
+
+    // Save the catalog and price it straight from the mapped file
+    const filesystem::path snapshotPath = filesystem::temp_directory_path() / "boxes-products.snap";
+    writeSnapshot(bigBox, snapshotPath);
+    {
+        const CatalogSnapshot snapshot(snapshotPath);
+        cout << "Snapshot of \"" << snapshot.name(0) << "\" with " << snapshot.size()
+             << " products, total price: " << snapshot.price() << endl;
+    }
+    filesystem::remove(snapshotPath);
+
     return 0;
-}
\ No newline at end of file
+}